@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+# Decodes the flight recorder dumps (see src/flightRecorder.h) that the
+# firmware prints at startup if it halted last time. (The same bytes can be
+# read over USB, with the '80 F0' command - see main.cpp. Put them between
+# 'FLIGHT' and 'END' lines to decode them.)
+#
+# Usage:
+#   decode_flight_record.py serial.log
+#   (Or pipe the log in on stdin.)
+
+import sys
+
+history_length = 32
+event_count = 8
+
+# Matches TraceEvent in src/trace.h.
+trace_events = [
+    'SOF',
+    'Poll start',
+    'Poll end',
+    'usbSetInterrupt',
+    'OUT packet',
+    'Rumble decode',
+    'EEPROM write',
+]
+
+f_cpu = 12800000
+microseconds_per_tick = 64 * 1000000 / f_cpu
+
+
+def read_dumps(lines):
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if line.endswith('FLIGHT'):
+            dump = bytearray()
+        elif dump is not None and line == 'END':
+            yield bytes(dump)
+            dump = None
+        elif dump is not None:
+            try:
+                dump.extend(int(field, 16) for field in line.split())
+            except ValueError:
+                dump = None
+
+
+def print_record(record):
+    expected_length = 1 + 4 + history_length * 3 + event_count * 4 + 1
+    if len(record) != expected_length:
+        print('Record is {} bytes - expected {}. Skipping.'.format(len(record), expected_length))
+        return
+
+    halt_code, osccal, mode, queue_cursor = record[1:5]
+    print('Halt code:            0x{:02X}'.format(halt_code))
+    print('OSCCAL:               {}'.format(osccal))
+    print('DualShock mode:       0x{:X}'.format(mode))
+    print('Command queue cursor: {}'.format(queue_cursor))
+
+    print('Command history (oldest first - report ID, command/sequence, UART command):')
+    history = record[5:5 + history_length * 3]
+    for i in range(0, len(history), 3):
+        report_id, command, uart_command = history[i:i + 3]
+        if report_id == 0 and command == 0 and uart_command == 0:
+            continue
+        if report_id == 0x10:
+            # Repeated rumble-only reports are collapsed into a count.
+            print('  10 (rumble) x{}'.format(command << 8 | uart_command))
+        else:
+            print('  {:02X} {:02X} {:02X}'.format(report_id, command, uart_command))
+
+    print('Last events (oldest first):')
+    events = record[5 + history_length * 3:-1]
+    first_time = None
+    for i in range(0, len(events), 4):
+        time = events[i] | events[i + 1] << 8
+        event, arg = events[i + 2:i + 4]
+        if time == 0xffff and event == 0xff:
+            continue
+        if first_time is None:
+            first_time = time
+        name = trace_events[event] if event < len(trace_events) else '0x{:02X}'.format(event)
+        # (Times are the bottom 16 bits of the tick count, so may wrap.)
+        ticks = (time - first_time) % 65536
+        print('  {:+8.0f}us {} 0x{:02X}'.format(ticks * microseconds_per_tick, name, arg))
+
+
+def main():
+    source = open(sys.argv[1], 'r', errors='replace') if len(sys.argv) > 1 else sys.stdin
+    for record in read_dumps(source):
+        print_record(record)
+        print()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# Turns the firmware's serial debug output, with tokenized log events (see
+# src/logTokens.h), back into text.
+#
+# Usage:
+#   decode_serial_log.py /dev/cu.usbserial-0001   (needs pyserial)
+#   decode_serial_log.py captured.bin
+#   decode_serial_log.py < captured.bin
+#   decode_serial_log.py --table                  (print the message table)
+
+import os
+import re
+import sys
+
+project_dir = os.path.dirname(os.path.abspath(__file__))
+tokens_header = os.path.join(project_dir, 'src', 'logTokens.h')
+
+baud_rate = 266667
+
+
+def load_message_table(path=tokens_header):
+    # The IDs are the messages' positions in the LOG_MESSAGES list.
+    with open(path, 'r') as f:
+        source = f.read()
+    messages = re.findall(r'LOG_MESSAGE\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', source)
+    return [(name, bytes(fmt, 'ascii').decode('unicode_escape')) for name, fmt in messages]
+
+
+def format_message(fmt, args):
+    out = []
+    position = 0
+    i = 0
+    while i < len(fmt):
+        ch = fmt[i]
+        if ch != '%' or i + 1 >= len(fmt):
+            out.append(ch)
+            i += 1
+            continue
+        spec = fmt[i + 1]
+        i += 2
+        if spec == '*':
+            out.append(' '.join('{:02X}'.format(b) for b in args[position:]))
+            position = len(args)
+            continue
+        size = {'b': 1, 'd': 1, 'w': 2, 'l': 4}.get(spec)
+        if size is None:
+            out.append('%' + spec)
+            continue
+        if position + size > len(args):
+            out.append('<missing>')
+            continue
+        value = int.from_bytes(args[position:position + size], 'little')
+        position += size
+        if spec == 'd':
+            out.append(str(value))
+        else:
+            out.append('{:0{}X}'.format(value, size * 2))
+    return ''.join(out)
+
+
+def decode(read_byte, write, table):
+    # Plain text is 7-bit, so any byte with its top bit set starts a frame of:
+    # 0x80 | id, argument length, arguments...
+    while True:
+        ch = read_byte()
+        if ch is None:
+            return
+        if ch < 0x80:
+            write(chr(ch))
+            continue
+
+        token = ch & 0x7f
+        length = read_byte()
+        if length is None:
+            return
+        args = bytearray()
+        while len(args) < length:
+            b = read_byte()
+            if b is None:
+                return
+            args.append(b)
+
+        if token < len(table):
+            write(format_message(table[token][1], args))
+        else:
+            write('<unknown token 0x{:02X}: {}>'.format(token, args.hex()))
+
+
+def main():
+    table = load_message_table()
+
+    if len(sys.argv) > 1 and sys.argv[1] == '--table':
+        for token, (name, fmt) in enumerate(table):
+            print('0x{:02X} {} {!r}'.format(token, name, fmt))
+        return
+
+    source = sys.argv[1] if len(sys.argv) > 1 else None
+    if source and (source.startswith('/dev/') or source.upper().startswith('COM')):
+        import serial
+        port = serial.Serial(source, baud_rate)
+
+        def read_byte():
+            data = port.read(1)
+            return data[0] if data else None
+    else:
+        stream = open(source, 'rb') if source else sys.stdin.buffer
+
+        def read_byte():
+            data = stream.read(1)
+            return data[0] if data else None
+
+    def write(text):
+        sys.stdout.write(text)
+        sys.stdout.flush()
+
+    try:
+        decode(read_byte, write, table)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
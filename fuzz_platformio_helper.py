@@ -0,0 +1,11 @@
+Import("env")
+
+# libFuzzer comes with clang, not gcc, so the 'nativeFuzz' environment needs
+# clang to compile and link everything - and the sanitizers need to be in
+# both.
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+
+# (AVRs don't care about alignment, so the firmware doesn't either. Nor does
+# avr-libc mind memcpy() being passed NULL with nothing to copy.)
+sanitizers = ["-fsanitize=fuzzer,address,undefined", "-fno-sanitize=alignment,nonnull-attribute"]
+env.Append(CCFLAGS=sanitizers + ["-g"], LINKFLAGS=sanitizers)
@@ -7,8 +7,13 @@ project_dir = env['PROJECT_DIR']
 include_dir = os.path.join(project_dir, 'include')
 os.makedirs(include_dir, exist_ok=True)
 
-# Generate 6 random bytes for the MAC address
-mac = [random.randrange(0, 256) for _ in range(6)]
+# Generate 6 random bytes for the MAC address - except in the host build
+# (see lib/avr-host), which always gets the same one so that its replies can
+# be compared from one build to the next (see replay_switch_traffic.py).
+if env['PIOPLATFORM'] == 'native':
+    mac = [0x02, 0x00, 0x00, 0x00, 0x00, 0x01]
+else:
+    mac = [random.randrange(0, 256) for _ in range(6)]
 msb_bytes = ', '.join('0x{:02x}'.format(b) for b in mac)
 lsb_bytes = ', '.join('0x{:02x}'.format(b) for b in reversed(mac))
 
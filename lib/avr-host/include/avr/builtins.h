@@ -0,0 +1,14 @@
+#ifndef __avr_host_builtins_h_included__
+#define __avr_host_builtins_h_included__
+
+// A stand-in for avr-gcc's <avr/builtins.h> for the host build. Only the
+// builtins the firmware uses are here, as ordinary functions.
+
+#include <stdint.h>
+
+// Each nybble of `map`, from least significant, says where bit 0-7 of the
+// result comes from: 0-7 is that bit of `bits`, and 0xf keeps the bit from
+// `value`.
+extern uint8_t __builtin_avr_insert_bits(uint32_t map, uint8_t bits, uint8_t value);
+
+#endif // __avr_host_builtins_h_included__
@@ -0,0 +1,39 @@
+#ifndef __avr_host_eeprom_h_included__
+#define __avr_host_eeprom_h_included__
+
+// A stand-in for avr-libc's <avr/eeprom.h> for the host build. The EEPROM is
+// `avrHostEeprom` (see avrHost.h). Accesses outside it abort.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <avrHost.h>
+
+#define EEMEM
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes take 8.5ms (the ATmega8's worst case, with an erase), during which
+// the EEPROM isn't ready.
+bool eeprom_is_ready(void);
+void eeprom_busy_wait(void);
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+uint16_t eeprom_read_word(const uint16_t *address);
+void eeprom_read_block(void *destination, const void *source, size_t length);
+
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_write_word(uint16_t *address, uint16_t value);
+void eeprom_write_block(const void *source, void *destination, size_t length);
+
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_update_word(uint16_t *address, uint16_t value);
+void eeprom_update_block(const void *source, void *destination, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __avr_host_eeprom_h_included__
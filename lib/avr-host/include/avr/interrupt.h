@@ -0,0 +1,26 @@
+#ifndef __avr_host_interrupt_h_included__
+#define __avr_host_interrupt_h_included__
+
+// A stand-in for avr-libc's <avr/interrupt.h> for the host build. Interrupt
+// handlers are ordinary functions, named after their vectors, which the
+// emulated hardware calls (see avrHost.h).
+
+#include <avr/io.h>
+#include <avrHost.h>
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#ifdef __cplusplus
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#else
+#define ISR(vector, ...) void vector(void); void vector(void)
+#endif
+
+#define EMPTY_INTERRUPT(vector) ISR(vector) {}
+
+#define sei() avrHostEnableInterrupts()
+#define cli() avrHostDisableInterrupts()
+
+#endif // __avr_host_interrupt_h_included__
@@ -0,0 +1,170 @@
+#ifndef __avr_host_io_h_included__
+#define __avr_host_io_h_included__
+
+// A stand-in for avr-libc's <avr/io.h> for the host build (the `native`
+// PlatformIO environment). It models an ATmega8.
+//
+// Most registers are just variables. The few whose accesses have side effects
+// the firmware relies on - the SPI and UART data registers, Timer 0's counter
+// and port B - are small C++ classes, so that writing SPDR exchanges a byte
+// with the attached device, writing UDR sends one, the timer moves on, and the
+// Dual Shock sees its 'attention' line change. See avrHost.h for how the
+// emulated hardware is driven.
+
+#include <stdint.h>
+
+#ifndef __AVR_ATmega8__
+#error "The host build models an ATmega8 - build with -D__AVR_ATmega8__=1"
+#endif
+
+// Lets the firmware know it's being built for the host.
+#define AVR_HOST 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile uint8_t PINB, DDRB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t MCUCR, MCUCSR, GICR, GIFR, OSCCAL, WDTCR;
+
+extern volatile uint8_t SPCR, SPSR;
+
+extern volatile uint8_t UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+
+extern volatile uint8_t TCCR0, TIMSK, TIFR;
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1, ICR1;
+
+extern volatile uint8_t EECR;
+
+#ifdef __cplusplus
+}
+
+// Writing calls `avrHostPortBWritten`.
+struct AvrHostPortRegister {
+    AvrHostPortRegister &operator=(uint8_t value);
+    AvrHostPortRegister &operator|=(const uint8_t bits) { return *this = value | bits; }
+    AvrHostPortRegister &operator&=(const uint8_t bits) { return *this = value & bits; }
+    AvrHostPortRegister &operator^=(const uint8_t bits) { return *this = value ^ bits; }
+    operator uint8_t() const { return value; }
+
+    volatile uint8_t value;
+};
+extern AvrHostPortRegister PORTB;
+
+// Writing starts an exchange with the attached device (see
+// `avrHostSpiExchange`), which finishes immediately. Reading gets what it sent
+// back.
+struct AvrHostSpiDataRegister {
+    AvrHostSpiDataRegister &operator=(uint8_t value);
+    operator uint8_t() const;
+};
+extern AvrHostSpiDataRegister SPDR;
+
+// Writing sends a character (see `avrHostUartTransmit`). Nothing is ever
+// received.
+struct AvrHostUartDataRegister {
+    AvrHostUartDataRegister &operator=(uint8_t value);
+    operator uint8_t() const;
+};
+extern AvrHostUartDataRegister UDR;
+
+// Reading moves the emulated time on a little (see `avrHostCycles()`) - it's
+// usually done in a loop waiting for time to pass.
+struct AvrHostTimerCounter {
+    operator uint8_t() const;
+};
+extern AvrHostTimerCounter TCNT0;
+#endif
+
+// Bits.
+
+#define _BV(bit) (1 << (bit))
+
+#define SREG_I 7
+
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define SM0 4
+#define SM1 5
+#define SM2 6
+#define SE 7
+#define INT0 6
+#define INT1 7
+#define INTF0 6
+#define INTF1 7
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE 6
+#define SPIE 7
+#define SPI2X 0
+#define WCOL 6
+#define SPIF 7
+
+#define MPCM 0
+#define U2X 1
+#define PE 2
+#define DOR 3
+#define FE 4
+#define UDRE 5
+#define TXC 6
+#define RXC 7
+#define TXB8 0
+#define RXB8 1
+#define UCSZ2 2
+#define TXEN 3
+#define RXEN 4
+#define UDRIE 5
+#define TXCIE 6
+#define RXCIE 7
+#define UCPOL 0
+#define UCSZ0 1
+#define UCSZ1 2
+#define USBS 3
+#define UPM0 4
+#define UPM1 5
+#define UMSEL 6
+#define URSEL 7
+
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define TOIE0 0
+#define TOV0 0
+#define TOIE1 2
+#define TOV1 2
+#define TICIE1 5
+#define ICF1 5
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define ICES1 6
+
+#define EERE 0
+#define EEWE 1
+#define EEMWE 2
+#define EERIE 3
+
+// Memories.
+
+#define RAMEND 0x45F
+#define E2END 0x1FF
+#define FLASHEND 0x1FFF
+
+#endif // __avr_host_io_h_included__
@@ -0,0 +1,34 @@
+#ifndef __avr_host_pgmspace_h_included__
+#define __avr_host_pgmspace_h_included__
+
+// A stand-in for avr-libc's <avr/pgmspace.h> for the host build. There's only
+// one address space, so 'program memory' is just constant data.
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#if AVR_HOST_PACKED_STRING_BENCH
+// Counted by packedStringBench.cpp - on the chip, each is an `lpm`.
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern uint32_t avrHostProgramMemoryByteReads;
+#ifdef __cplusplus
+}
+#endif
+#define pgm_read_byte(address) (++avrHostProgramMemoryByteReads, *(const uint8_t *)(address))
+#else
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#endif
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(void * const *)(address))
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+
+#endif // __avr_host_pgmspace_h_included__
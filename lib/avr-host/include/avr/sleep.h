@@ -0,0 +1,18 @@
+#ifndef __avr_host_sleep_h_included__
+#define __avr_host_sleep_h_included__
+
+// A stand-in for avr-libc's <avr/sleep.h> for the host build.
+
+#include <avr/io.h>
+#include <avrHost.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE (_BV(SM0) | _BV(SM1))
+
+#define set_sleep_mode(mode) (MCUCR = (MCUCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode))
+#define sleep_enable() (MCUCR |= _BV(SE))
+#define sleep_disable() (MCUCR &= ~_BV(SE))
+#define sleep_cpu() avrHostSleep()
+
+#endif // __avr_host_sleep_h_included__
@@ -0,0 +1,109 @@
+#ifndef __avrhost_h_included__
+#define __avrhost_h_included__
+
+// The emulated ATmega8, and the world around it, that the firmware runs on
+// in the host build (the `native` PlatformIO environment).
+//
+// This isn't a simulator - the firmware is compiled for the host, and only
+// what it actually uses is emulated, just well enough for it to run:
+// - Time is counted in CPU cycles, but only moves on when the firmware sleeps,
+//   delays, waits on the SPI or reads Timer 0 - code itself takes no time.
+// - Timer 0 overflows, the UART's transmit complete, the EEPROM being ready
+//   and the Dual Shock's ACK (INT1) raise interrupts, which run as soon as
+//   interrupts are enabled.
+// - The SPI exchanges bytes with `avrHostSpiExchange`, and port B's outputs
+//   are passed to `avrHostPortBWritten` - dualShockModel.h attaches a
+//   pretend Dual Shock to these.
+// - The UART sends its output to `avrHostUartTransmit`.
+// - The EEPROM is `avrHostEeprom`. Writes take as long as on the real thing.
+// - V-USB is replaced with a pretend USB host: while `avrHostUsbConnected` is
+//   set there's a SOF every millisecond, and at each one any interrupt IN
+//   packet the firmware has queued up with `usbSetInterrupt()` is collected
+//   and passed to `avrHostUsbInterruptCollected`. OUT and SETUP packets can be
+//   sent with `avrHostUsbSendOut()` and `avrHostUsbSendSetup()`.
+//
+// Unless the program it's linked into has its own `main()` (as the unit tests
+// in test/ do), the firmware starts up as normal (see hostMain.cpp). With
+// AVR_HOST_FUZZ, it's a libFuzzer target instead (see fuzzUsbOut.cpp), with
+// AVR_HOST_RUMBLE_CHECK it checks the rumble decoder (see rumbleCheck.cpp),
+// and with AVR_HOST_PACKED_STRING_BENCH it compares the packed string
+// decoders (see packedStringBench.cpp).
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+#ifndef AVR_HOST_FUZZ
+#define AVR_HOST_FUZZ 0
+#endif
+
+#ifndef AVR_HOST_RUMBLE_CHECK
+#define AVR_HOST_RUMBLE_CHECK 0
+#endif
+
+#ifndef AVR_HOST_PACKED_STRING_BENCH
+#define AVR_HOST_PACKED_STRING_BENCH 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Time.
+
+uint64_t avrHostCycles(void);
+void avrHostAdvanceCycles(uint32_t cycles);
+
+// What `sleep_cpu()` does - move time on to the next interrupt that can wake
+// us in the current sleep mode.
+void avrHostSleep(void);
+
+// The firmware calls this when it halts, rather than spinning forever - which
+// nobody could tell from being busy. It calls `avrHostHalted`, if that's set
+// (it mustn't return) - or otherwise stops the program with abort(), which
+// debuggers notice.
+void avrHostHalt(void);
+extern void (*avrHostHalted)(void);
+
+// Interrupts.
+
+void avrHostEnableInterrupts(void);
+void avrHostDisableInterrupts(void);
+
+// Peripherals.
+
+// Called for each byte the SPI sends, to get the byte received in exchange.
+// The default behaves like nothing is attached, and returns 0xff.
+extern uint8_t (*avrHostSpiExchange)(uint8_t sent);
+
+// Called whenever PORTB is written to. The default does nothing.
+extern void (*avrHostPortBWritten)(uint8_t previous, uint8_t value);
+
+// Pulls INT1's pin low (i.e. the Dual Shock's ACK line) after the given number
+// of cycles, raising the interrupt.
+void avrHostPullInt1Low(uint32_t afterCycles);
+
+// Called for each character the UART sends. The default writes them to
+// stdout.
+extern void (*avrHostUartTransmit)(uint8_t ch);
+
+extern uint8_t avrHostEeprom[E2END + 1];
+
+// USB.
+
+extern bool avrHostUsbConnected;
+
+// Called for each interrupt IN packet collected from the firmware. The default
+// does nothing.
+extern void (*avrHostUsbInterruptCollected)(const uint8_t *data, uint8_t length);
+
+// Queue up a packet to be handled by the next `usbPoll()`. They return false
+// (and drop it) if the last one hasn't been handled yet.
+bool avrHostUsbSendOut(uint8_t endpoint, const uint8_t *data, uint8_t length);
+bool avrHostUsbSendSetup(const uint8_t *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __avrhost_h_included__
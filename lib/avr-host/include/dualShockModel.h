@@ -0,0 +1,72 @@
+#ifndef __dualshockmodel_h_included__
+#define __dualshockmodel_h_included__
+
+// A pretend Dual Shock, for the host build, attached to the emulated ATmega8
+// the same way as the real one: 'attention' on PB2, the SPI on PB3-PB5 and
+// 'acknowledge' on INT1.
+//
+// It understands the commands the firmware sends - 0x42 (poll, with the
+// motors), 0x43 (enter/exit config mode), 0x44 (switch between digital and
+// analog) and 0x4D (map the motors) - and replies in digital (0x41), analog
+// (0x73) or config (0xF3) mode like the real thing. Like the real thing, it
+// starts up in digital mode, and doesn't acknowledge the last byte of each
+// transaction.
+//
+// It can also be made to misbehave, in the ways real ones do, to exercise the
+// firmware's recovery from them.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum DualShockModelMode {
+    DUAL_SHOCK_MODEL_DIGITAL = 0x41,
+    DUAL_SHOCK_MODEL_ANALOG = 0x73,
+    DUAL_SHOCK_MODEL_CONFIG = 0xF3,
+} DualShockModelMode;
+
+typedef enum DualShockModelFault {
+    // The next transaction stops being acknowledged after its header, as if
+    // the controller had given up.
+    DUAL_SHOCK_MODEL_FAULT_DROPPED_ACK,
+
+    // The next transaction's third byte is garbage, rather than 0x5a.
+    DUAL_SHOCK_MODEL_FAULT_BAD_HEADER,
+
+    // Drops back to digital mode straight away, like when the 'ANALOG' button
+    // is pressed.
+    DUAL_SHOCK_MODEL_FAULT_MODE_SWITCH,
+} DualShockModelFault;
+
+// Plugs it in, in digital mode, with nothing pressed and the sticks centred.
+void dualShockModelAttach(void);
+
+// How long after each byte it pulls the ACK line low. Real ones take 10-20us.
+void dualShockModelSetAckLatencyMicros(uint8_t micros);
+
+// `buttons` has buttons1 (see DualShockReport) in its low byte, and buttons2
+// in its high byte. Set bits are pressed.
+void dualShockModelSetButtons(uint16_t buttons);
+void dualShockModelSetSticks(uint8_t rightX, uint8_t rightY, uint8_t leftX, uint8_t leftY);
+
+void dualShockModelInjectFault(DualShockModelFault fault);
+
+DualShockModelMode dualShockModelMode(void);
+
+// What the motors were last set to. The small motor is only on or off.
+bool dualShockModelSmallMotorOn(void);
+uint8_t dualShockModelLargeMotor(void);
+
+// Counts of completed transactions, and of those that were abandoned (i.e.
+// deselected early).
+uint32_t dualShockModelTransactionCount(void);
+uint32_t dualShockModelAbandonedCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __dualshockmodel_h_included__
@@ -0,0 +1,44 @@
+#ifndef __usbreplay_h_included__
+#define __usbreplay_h_included__
+
+// Replays recorded USB traffic from the Switch into the host build's pretend
+// USB host (see avrHost.h).
+//
+// A recording is a text file with one transfer per line:
+//   <milliseconds> OUT <report bytes, in hex>
+//   <milliseconds> SETUP <8 request bytes, in hex>
+// `#` starts a comment. Times are since the firmware started up, and should
+// be in order - or, starting with `+`, since the last transfer was sent and,
+// if it was a command that gets a reply, the firmware replied. That's how the
+// Switch paces its commands, so it lets recordings measure how quickly we
+// answer. OUT reports are padded to 64 bytes with zeros, like the Switch
+// does, and sent to endpoint 1 as 8-byte packets - at most one per frame, like
+// a real host, and only once the firmware has taken the last.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns false, having printed why to stderr, if the file can't be read.
+bool usbReplayLoad(const char *path);
+
+// Sends whatever's due. Call it every time round the main loop.
+void usbReplayStep(void);
+
+bool usbReplayFinished(void);
+
+// Pass it each interrupt IN packet collected from the firmware, so that it
+// can tell when replies arrive.
+void usbReplayInterruptCollected(const uint8_t *data, uint8_t length);
+
+// Called for each packet as it's sent. The default does nothing.
+extern void (*usbReplayPacketSent)(uint8_t token, const uint8_t *data, uint8_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __usbreplay_h_included__
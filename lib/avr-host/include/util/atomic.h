@@ -0,0 +1,35 @@
+#ifndef __avr_host_atomic_h_included__
+#define __avr_host_atomic_h_included__
+
+// A stand-in for avr-libc's <util/atomic.h> for the host build (C++ only).
+// Like the real thing, interrupts are disabled for the block and restored (or
+// forced on) however it's left.
+
+#include <avr/io.h>
+#include <avrHost.h>
+
+struct AvrHostAtomicBlock {
+    explicit AvrHostAtomicBlock(const bool restoreState)
+        : interruptsWereEnabled(SREG & (1 << SREG_I)), forceOn(!restoreState), done(false)
+    {
+        avrHostDisableInterrupts();
+    }
+
+    ~AvrHostAtomicBlock()
+    {
+        if(interruptsWereEnabled || forceOn) {
+            avrHostEnableInterrupts();
+        }
+    }
+
+    const bool interruptsWereEnabled;
+    const bool forceOn;
+    bool done;
+};
+
+#define ATOMIC_RESTORESTATE true
+#define ATOMIC_FORCEON false
+
+#define ATOMIC_BLOCK(type) for(AvrHostAtomicBlock avrHostAtomicBlock(type); !avrHostAtomicBlock.done; avrHostAtomicBlock.done = true)
+
+#endif // __avr_host_atomic_h_included__
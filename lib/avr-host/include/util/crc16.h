@@ -0,0 +1,35 @@
+#ifndef __avr_host_crc16_h_included__
+#define __avr_host_crc16_h_included__
+
+// A stand-in for avr-libc's <util/crc16.h> for the host build, with the same
+// (C equivalent) implementations avr-libc documents.
+
+#include <stdint.h>
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    data ^= crc;
+    for(uint8_t i = 0; i < 8; ++i) {
+        if(data & 0x80) {
+            data = (data << 1) ^ 0x07;
+        } else {
+            data <<= 1;
+        }
+    }
+    return data;
+}
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data)
+{
+    crc ^= data;
+    for(uint8_t i = 0; i < 8; ++i) {
+        if(crc & 1) {
+            crc = (crc >> 1) ^ 0xa001;
+        } else {
+            crc >>= 1;
+        }
+    }
+    return crc;
+}
+
+#endif // __avr_host_crc16_h_included__
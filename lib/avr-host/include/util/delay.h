@@ -0,0 +1,12 @@
+#ifndef __avr_host_delay_h_included__
+#define __avr_host_delay_h_included__
+
+// A stand-in for avr-libc's <util/delay.h> for the host build. Delays move the
+// emulated time on (see avrHost.h).
+
+#include <avrHost.h>
+
+#define _delay_us(us) avrHostAdvanceCycles((uint32_t)((us) * (F_CPU / 1000000.0)))
+#define _delay_ms(ms) avrHostAdvanceCycles((uint32_t)((ms) * (F_CPU / 1000.0)))
+
+#endif // __avr_host_delay_h_included__
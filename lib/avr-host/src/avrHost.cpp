@@ -0,0 +1,418 @@
+#include <avrHost.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/builtins.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+    // The firmware's interrupt handlers.
+    void TIMER0_OVF_vect(void);
+    void INT1_vect(void);
+    void USART_TXC_vect(void);
+    void EE_RDY_vect(void);
+}
+
+// Registers.
+
+volatile uint8_t PINB, DDRB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+
+volatile uint8_t SREG;
+volatile uint8_t MCUCR, MCUCSR, GICR, GIFR, OSCCAL, WDTCR;
+
+volatile uint8_t SPCR, SPSR;
+
+volatile uint8_t UCSRA = 1 << UDRE, UCSRB, UCSRC = 1 << URSEL | 1 << UCSZ1 | 1 << UCSZ0, UBRRH, UBRRL;
+
+volatile uint8_t TCCR0, TIMSK, TIFR;
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1, ICR1;
+
+volatile uint8_t EECR;
+
+AvrHostPortRegister PORTB;
+AvrHostSpiDataRegister SPDR;
+AvrHostUartDataRegister UDR;
+AvrHostTimerCounter TCNT0;
+
+// Time.
+
+static uint64_t sCycles = 0;
+
+static const uint64_t sNever = UINT64_MAX;
+static uint64_t sInt1LowAtCycles = sNever;
+
+// When the EEPROM finishes its current write.
+static uint64_t sEepromReadyAtCycles = 0;
+
+// USB frames start every millisecond.
+static const uint32_t sCyclesPerFrame = F_CPU / 1000;
+
+// Timer 0 counts every 64 cycles (see timer.cpp), and overflows every 256
+// counts.
+static const uint32_t sCyclesPerTimer0Count = 64;
+static const uint32_t sCyclesPerTimer0Overflow = sCyclesPerTimer0Count * 256;
+
+// A rough cost for reading the timer and going round whatever loop is waiting
+// on it. It has to be something, or waiting loops would never end.
+static const uint32_t sCyclesPerTimer0Read = 16;
+
+static void serviceInterrupts();
+
+// The pretend USB host, in usbdrvHost.cpp.
+void avrHostUsbStartOfFrame();
+
+uint64_t avrHostCycles()
+{
+    return sCycles;
+}
+
+static uint64_t nextMultiple(const uint64_t cycles, const uint32_t period)
+{
+    return (cycles / period + 1) * period;
+}
+
+static void raiseTimer0Overflow()
+{
+    TIFR |= 1 << TOV0;
+}
+
+void avrHostAdvanceCycles(uint32_t cycles)
+{
+    // Step from event to event, so that everything happens in the right order.
+    while(cycles) {
+        const uint64_t nextOverflow = nextMultiple(sCycles, sCyclesPerTimer0Overflow);
+        const uint64_t nextFrame = nextMultiple(sCycles, sCyclesPerFrame);
+        uint64_t nextEvent = nextOverflow < nextFrame ? nextOverflow : nextFrame;
+        if(sInt1LowAtCycles < nextEvent) {
+            nextEvent = sInt1LowAtCycles;
+        }
+        if(sEepromReadyAtCycles > sCycles && sEepromReadyAtCycles < nextEvent) {
+            nextEvent = sEepromReadyAtCycles;
+        }
+        if(sCycles + cycles < nextEvent) {
+            sCycles += cycles;
+            break;
+        }
+
+        cycles -= nextEvent - sCycles;
+        sCycles = nextEvent;
+        if(sCycles == nextOverflow && (TCCR0 & 0b111)) {
+            raiseTimer0Overflow();
+        }
+        if(sCycles == nextFrame && avrHostUsbConnected) {
+            avrHostUsbStartOfFrame();
+        }
+        if(sCycles == sInt1LowAtCycles) {
+            sInt1LowAtCycles = sNever;
+            GIFR |= 1 << INTF1;
+        }
+        if(SREG & (1 << SREG_I)) {
+            serviceInterrupts();
+        }
+    }
+}
+
+AvrHostTimerCounter::operator uint8_t() const
+{
+    const uint8_t count = (uint8_t)(sCycles / sCyclesPerTimer0Count);
+    avrHostAdvanceCycles(sCyclesPerTimer0Read);
+    return count;
+}
+
+void avrHostSleep()
+{
+    if(!(MCUCR & (1 << SE))) {
+        return;
+    }
+    if(!(SREG & (1 << SREG_I))) {
+        // Nothing can wake us. Like simavr, take this as the firmware saying
+        // it's finished.
+        fflush(stdout);
+        fprintf(stderr, "avrHost: Sleeping with interrupts disabled - stopping.\n");
+        exit(0);
+    }
+
+    // USB traffic (INT0) wakes us from any sleep mode - as long as there is
+    // some. The Timer 0 overflow and the EEPROM being ready only wake us from
+    // idle. If nothing will wake us, let time pass anyway, a frame at a time,
+    // so that whoever's driving us gets a look in.
+    const bool idle = !(MCUCR & (1 << SM0 | 1 << SM1 | 1 << SM2));
+    if(idle && (EECR & (1 << EERIE)) && sCycles >= sEepromReadyAtCycles) {
+        // (It's already waiting to wake us.)
+        serviceInterrupts();
+        return;
+    }
+    uint64_t wakeAt = nextMultiple(sCycles, sCyclesPerFrame);
+    if(idle && (TIMSK & (1 << TOIE0)) && (TCCR0 & 0b111)) {
+        const uint64_t nextOverflow = nextMultiple(sCycles, sCyclesPerTimer0Overflow);
+        if(nextOverflow < wakeAt) {
+            wakeAt = nextOverflow;
+        }
+    }
+    if(idle && (EECR & (1 << EERIE)) && sEepromReadyAtCycles > sCycles && sEepromReadyAtCycles < wakeAt) {
+        wakeAt = sEepromReadyAtCycles;
+    }
+    avrHostAdvanceCycles(wakeAt - sCycles);
+}
+
+void (*avrHostHalted)(void) = NULL;
+
+void avrHostHalt()
+{
+    if(avrHostHalted) {
+        avrHostHalted();
+    }
+    fflush(stdout);
+    fprintf(stderr, "avrHost: The firmware halted.\n");
+    abort();
+}
+
+// Interrupts.
+
+static bool sServicingInterrupts = false;
+
+static void serviceInterrupts()
+{
+    // Interrupts that happen while we're in here are picked up next time round
+    // the loop, rather than interrupting the handler that caused them.
+    if(sServicingInterrupts) {
+        return;
+    }
+    sServicingInterrupts = true;
+
+    bool serviced;
+    do {
+        serviced = false;
+        if((GIFR & (1 << INTF1)) && (GICR & (1 << INT1))) {
+            GIFR &= ~(1 << INTF1);
+            INT1_vect();
+            serviced = true;
+        }
+        if((TIFR & (1 << TOV0)) && (TIMSK & (1 << TOIE0))) {
+            TIFR &= ~(1 << TOV0);
+            TIMER0_OVF_vect();
+            serviced = true;
+        }
+        if((UCSRA & (1 << TXC)) && (UCSRB & (1 << TXCIE))) {
+            UCSRA &= ~(1 << TXC);
+            USART_TXC_vect();
+            serviced = true;
+        }
+        // (Not a flag - it fires for as long as the EEPROM's ready.)
+        if((EECR & (1 << EERIE)) && sCycles >= sEepromReadyAtCycles) {
+            EE_RDY_vect();
+            serviced = true;
+        }
+    } while(serviced && (SREG & (1 << SREG_I)));
+
+    sServicingInterrupts = false;
+}
+
+void avrHostEnableInterrupts()
+{
+    SREG |= 1 << SREG_I;
+    serviceInterrupts();
+}
+
+void avrHostDisableInterrupts()
+{
+    SREG &= ~(1 << SREG_I);
+}
+
+void avrHostPullInt1Low(const uint32_t afterCycles)
+{
+    if(afterCycles == 0) {
+        GIFR |= 1 << INTF1;
+        if(SREG & (1 << SREG_I)) {
+            serviceInterrupts();
+        }
+    } else {
+        sInt1LowAtCycles = sCycles + afterCycles;
+    }
+}
+
+// Port B.
+
+static void noPortBDevice(const uint8_t previous, const uint8_t value)
+{
+    (void)previous;
+    (void)value;
+}
+
+void (*avrHostPortBWritten)(uint8_t previous, uint8_t value) = noPortBDevice;
+
+AvrHostPortRegister &AvrHostPortRegister::operator=(const uint8_t newValue)
+{
+    const uint8_t previous = value;
+    value = newValue;
+    avrHostPortBWritten(previous, newValue);
+    return *this;
+}
+
+// SPI.
+
+static uint8_t noSpiDevice(const uint8_t sent)
+{
+    (void)sent;
+    return 0xff;
+}
+
+uint8_t (*avrHostSpiExchange)(uint8_t sent) = noSpiDevice;
+
+static uint8_t sSpiReceived = 0xff;
+
+AvrHostSpiDataRegister &AvrHostSpiDataRegister::operator=(const uint8_t value)
+{
+    // Eight bits, at F_CPU / (4, 16, 64 or 128), or twice that with SPI2X.
+    static const uint8_t sClockDividers[] = { 4, 16, 64, 128 };
+    uint32_t cyclesPerBit = sClockDividers[SPCR & (1 << SPR1 | 1 << SPR0)];
+    if(SPSR & (1 << SPI2X)) {
+        cyclesPerBit /= 2;
+    }
+    avrHostAdvanceCycles(cyclesPerBit * 8);
+
+    sSpiReceived = avrHostSpiExchange(value);
+    SPSR |= 1 << SPIF;
+    return *this;
+}
+
+AvrHostSpiDataRegister::operator uint8_t() const
+{
+    SPSR &= ~(1 << SPIF);
+    return sSpiReceived;
+}
+
+// UART.
+
+static void uartTransmitToStdout(const uint8_t ch)
+{
+    putchar(ch);
+}
+
+void (*avrHostUartTransmit)(uint8_t ch) = uartTransmitToStdout;
+
+AvrHostUartDataRegister &AvrHostUartDataRegister::operator=(const uint8_t value)
+{
+    // Sending takes no (emulated) time at all.
+    avrHostUartTransmit(value);
+    UCSRA |= 1 << TXC | 1 << UDRE;
+    if(SREG & (1 << SREG_I)) {
+        serviceInterrupts();
+    }
+    return *this;
+}
+
+AvrHostUartDataRegister::operator uint8_t() const
+{
+    return 0;
+}
+
+// EEPROM.
+
+uint8_t avrHostEeprom[E2END + 1];
+
+// Like a new chip, the EEPROM starts out erased.
+static struct EepromEraser {
+    EepromEraser()
+    {
+        memset(avrHostEeprom, 0xff, sizeof(avrHostEeprom));
+    }
+} sEepromEraser;
+
+static const uint32_t sCyclesPerEepromWrite = (uint32_t)(F_CPU * 0.0085);
+
+static uint8_t *eepromBytes(const volatile void *address, const size_t length)
+{
+    const uintptr_t offset = (uintptr_t)address;
+    if(offset + length > sizeof(avrHostEeprom)) {
+        fprintf(stderr, "avrHost: EEPROM access out of range: 0x%lx, length %lu\n", (unsigned long)offset, (unsigned long)length);
+        abort();
+    }
+    return &avrHostEeprom[offset];
+}
+
+bool eeprom_is_ready()
+{
+    return sCycles >= sEepromReadyAtCycles;
+}
+
+void eeprom_busy_wait()
+{
+    if(!eeprom_is_ready()) {
+        avrHostAdvanceCycles(sEepromReadyAtCycles - sCycles);
+    }
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    eeprom_busy_wait();
+    return *eepromBytes(address, 1);
+}
+
+uint16_t eeprom_read_word(const uint16_t *address)
+{
+    uint16_t value;
+    eeprom_read_block(&value, address, sizeof(value));
+    return value;
+}
+
+void eeprom_read_block(void *destination, const void *source, const size_t length)
+{
+    eeprom_busy_wait();
+    memcpy(destination, eepromBytes(source, length), length);
+}
+
+void eeprom_write_byte(uint8_t *address, const uint8_t value)
+{
+    eeprom_busy_wait();
+    *eepromBytes(address, 1) = value;
+    sEepromReadyAtCycles = sCycles + sCyclesPerEepromWrite;
+}
+
+void eeprom_write_word(uint16_t *address, const uint16_t value)
+{
+    eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_block(const void *source, void *destination, const size_t length)
+{
+    for(size_t i = 0; i < length; ++i) {
+        eeprom_write_byte((uint8_t *)destination + i, ((const uint8_t *)source)[i]);
+    }
+}
+
+void eeprom_update_byte(uint8_t *address, const uint8_t value)
+{
+    if(eeprom_read_byte(address) != value) {
+        eeprom_write_byte(address, value);
+    }
+}
+
+void eeprom_update_word(uint16_t *address, const uint16_t value)
+{
+    eeprom_update_block(&value, address, sizeof(value));
+}
+
+void eeprom_update_block(const void *source, void *destination, const size_t length)
+{
+    for(size_t i = 0; i < length; ++i) {
+        eeprom_update_byte((uint8_t *)destination + i, ((const uint8_t *)source)[i]);
+    }
+}
+
+// Builtins.
+
+uint8_t __builtin_avr_insert_bits(const uint32_t map, const uint8_t bits, const uint8_t value)
+{
+    uint8_t result = 0;
+    for(uint8_t i = 0; i < 8; ++i) {
+        const uint8_t source = (map >> (i * 4)) & 0xf;
+        const uint8_t bit = source == 0xf ? (value >> i) & 1 : (bits >> source) & 1;
+        result |= bit << i;
+    }
+    return result;
+}
@@ -0,0 +1,241 @@
+#include <dualShockModel.h>
+#include <avrHost.h>
+#include <string.h>
+
+// Each transaction, while 'attention' is low, goes:
+//   0: 0x01 in, 0xff out.
+//   1: The command in, the mode out. The mode's low nybble is how many 16-bit
+//      words of data follow the header.
+//   2: The command's first argument in (ignored by everything we understand),
+//      0x5a out.
+//   3+: The command's other arguments in, data out.
+// Every byte but the last is acknowledged. What a command does happens once
+// its last byte's been exchanged.
+
+static const uint8_t sMaximumDataLength = 6;
+
+static DualShockModelMode sMode = DUAL_SHOCK_MODEL_DIGITAL;
+
+// What to go back to when leaving config mode.
+static DualShockModelMode sModeOutsideConfig = DUAL_SHOCK_MODEL_DIGITAL;
+
+static uint32_t sAckLatencyCycles = 10 * (F_CPU / 1000000);
+
+// Active-low, like on the wire.
+static uint8_t sButtons[2] = { 0xff, 0xff };
+static uint8_t sSticks[4] = { 0x80, 0x80, 0x80, 0x80 };
+
+// Which motor each data byte of a poll drives: 0x00 for the small one, 0x01
+// for the large one, 0xff for neither.
+static uint8_t sMotorMap[sMaximumDataLength] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+static bool sSmallMotorOn = false;
+static uint8_t sLargeMotor = 0;
+
+static bool sDropAckPending = false;
+static bool sBadHeaderPending = false;
+
+// The current transaction.
+static bool sSelected = false;
+static bool sIgnoring = false;
+static bool sDropAck = false;
+static bool sBadHeader = false;
+static uint8_t sByteIndex = 0;
+static uint8_t sCommand = 0;
+static uint8_t sTransactionLength = 0;
+static uint8_t sReply[sMaximumDataLength];
+static uint8_t sArguments[sMaximumDataLength];
+
+static uint32_t sTransactionCount = 0;
+static uint32_t sAbandonedCount = 0;
+
+static void prepareReply()
+{
+    sTransactionLength = 3 + (sMode & 0xf) * 2;
+
+    if(sMode == DUAL_SHOCK_MODEL_CONFIG && sCommand == 0x44) {
+        memset(sReply, 0, sizeof(sReply));
+    } else if(sMode == DUAL_SHOCK_MODEL_CONFIG && sCommand == 0x4D) {
+        // It replies with the old map.
+        memcpy(sReply, sMotorMap, sizeof(sReply));
+    } else {
+        // Anything else gets the controller's state.
+        sReply[0] = sButtons[0];
+        sReply[1] = sButtons[1];
+        memcpy(sReply + 2, sSticks, sizeof(sSticks));
+    }
+}
+
+static void execute()
+{
+    switch(sCommand) {
+        case 0x42:
+            for(uint8_t i = 0; i < sTransactionLength - 3; ++i) {
+                if(sMotorMap[i] == 0x00) {
+                    sSmallMotorOn = (sArguments[i] == 0xff);
+                } else if(sMotorMap[i] == 0x01) {
+                    sLargeMotor = sArguments[i];
+                }
+            }
+            break;
+
+        case 0x43:
+            if(sArguments[0] == 0x01 && sMode != DUAL_SHOCK_MODEL_CONFIG) {
+                sModeOutsideConfig = sMode;
+                sMode = DUAL_SHOCK_MODEL_CONFIG;
+            } else if(sArguments[0] == 0x00 && sMode == DUAL_SHOCK_MODEL_CONFIG) {
+                sMode = sModeOutsideConfig;
+            }
+            break;
+
+        case 0x44:
+            if(sMode == DUAL_SHOCK_MODEL_CONFIG) {
+                sModeOutsideConfig = sArguments[0] == 0x01 ? DUAL_SHOCK_MODEL_ANALOG : DUAL_SHOCK_MODEL_DIGITAL;
+            }
+            break;
+
+        case 0x4D:
+            if(sMode == DUAL_SHOCK_MODEL_CONFIG) {
+                memcpy(sMotorMap, sArguments, sizeof(sMotorMap));
+            }
+            break;
+    }
+}
+
+static void portBWritten(const uint8_t previous, const uint8_t value)
+{
+    const uint8_t attention = 1 << 2;
+    if((previous & attention) && !(value & attention)) {
+        sSelected = true;
+        sIgnoring = false;
+        sByteIndex = 0;
+        memset(sArguments, 0, sizeof(sArguments));
+
+        sDropAck = sDropAckPending;
+        sDropAckPending = false;
+        sBadHeader = sBadHeaderPending;
+        sBadHeaderPending = false;
+    } else if(!(previous & attention) && (value & attention)) {
+        if(sSelected && !sIgnoring && sByteIndex > 0 && sByteIndex < sTransactionLength) {
+            ++sAbandonedCount;
+        }
+        sSelected = false;
+    }
+}
+
+static uint8_t spiExchange(const uint8_t sent)
+{
+    if(!sSelected || sIgnoring) {
+        return 0xff;
+    }
+
+    uint8_t reply;
+    if(sByteIndex == 0) {
+        if(sent != 0x01) {
+            // Not for us (it would be for a memory card).
+            sIgnoring = true;
+            return 0xff;
+        }
+        // Not known until the command arrives.
+        sTransactionLength = 0xff;
+        reply = 0xff;
+    } else if(sByteIndex == 1) {
+        sCommand = sent;
+        prepareReply();
+        reply = sMode;
+    } else if(sByteIndex == 2) {
+        reply = sBadHeader ? 0x55 : 0x5a;
+    } else if(sByteIndex < sTransactionLength) {
+        sArguments[sByteIndex - 3] = sent;
+        reply = sReply[sByteIndex - 3];
+    } else {
+        // Clocked past the end.
+        sIgnoring = true;
+        return 0xff;
+    }
+
+    ++sByteIndex;
+    if(sByteIndex < sTransactionLength) {
+        if(!(sDropAck && sByteIndex >= 3)) {
+            avrHostPullInt1Low(sAckLatencyCycles);
+        }
+    } else {
+        execute();
+        ++sTransactionCount;
+    }
+    return reply;
+}
+
+void dualShockModelAttach()
+{
+    sMode = DUAL_SHOCK_MODEL_DIGITAL;
+    sModeOutsideConfig = DUAL_SHOCK_MODEL_DIGITAL;
+    dualShockModelSetButtons(0);
+    dualShockModelSetSticks(0x80, 0x80, 0x80, 0x80);
+    memset(sMotorMap, 0xff, sizeof(sMotorMap));
+    sSmallMotorOn = false;
+    sLargeMotor = 0;
+    sSelected = false;
+
+    avrHostSpiExchange = spiExchange;
+    avrHostPortBWritten = portBWritten;
+}
+
+void dualShockModelSetAckLatencyMicros(const uint8_t micros)
+{
+    sAckLatencyCycles = micros * (F_CPU / 1000000);
+}
+
+void dualShockModelSetButtons(const uint16_t buttons)
+{
+    sButtons[0] = ~(uint8_t)buttons;
+    sButtons[1] = ~(uint8_t)(buttons >> 8);
+}
+
+void dualShockModelSetSticks(const uint8_t rightX, const uint8_t rightY, const uint8_t leftX, const uint8_t leftY)
+{
+    sSticks[0] = rightX;
+    sSticks[1] = rightY;
+    sSticks[2] = leftX;
+    sSticks[3] = leftY;
+}
+
+void dualShockModelInjectFault(const DualShockModelFault fault)
+{
+    switch(fault) {
+        case DUAL_SHOCK_MODEL_FAULT_DROPPED_ACK:
+            sDropAckPending = true;
+            break;
+        case DUAL_SHOCK_MODEL_FAULT_BAD_HEADER:
+            sBadHeaderPending = true;
+            break;
+        case DUAL_SHOCK_MODEL_FAULT_MODE_SWITCH:
+            sMode = DUAL_SHOCK_MODEL_DIGITAL;
+            sModeOutsideConfig = DUAL_SHOCK_MODEL_DIGITAL;
+            break;
+    }
+}
+
+DualShockModelMode dualShockModelMode()
+{
+    return sMode;
+}
+
+bool dualShockModelSmallMotorOn()
+{
+    return sSmallMotorOn;
+}
+
+uint8_t dualShockModelLargeMotor()
+{
+    return sLargeMotor;
+}
+
+uint32_t dualShockModelTransactionCount()
+{
+    return sTransactionCount;
+}
+
+uint32_t dualShockModelAbandonedCount()
+{
+    return sAbandonedCount;
+}
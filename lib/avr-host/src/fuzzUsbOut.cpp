@@ -0,0 +1,281 @@
+#include <avrHost.h>
+
+#if AVR_HOST_FUZZ
+
+#include <dualShockModel.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+    #include <usbdrv/usbdrv.h>
+}
+
+// A libFuzzer target for everything the Switch can send us - OUT packets, and
+// the CLEAR_FEATURE(ENDPOINT_HALT) requests that abandon half-received
+// reports. Build it with the 'nativeFuzz' environment, and run it with e.g.
+// `.pio/build/nativeFuzz/program -max_len=4096 corpus/ replays/fuzz_corpus/`
+// (libFuzzer adds what it finds to the first directory). The seeds in
+// replays/fuzz_corpus/ are made from recordings with `replay_to_fuzz_seed.py`.
+//
+// Each input is a sequence of operations, each starting with a byte:
+//   0x00-0x7f  An OUT packet of (byte & 0x7) + 1 bytes, which follow.
+//   0x80-0xbf  A CLEAR_FEATURE(ENDPOINT_HALT) for endpoint 1.
+//   0xc0-0xff  Let (byte & 0x3f) + 1 frames pass.
+//
+// There's no way to reset all of the firmware's (and the emulation's) static
+// state, so each input runs in a child process, forked from one where the
+// firmware has just started up. Every input starts from the same place, so
+// a crash can be reproduced from the input libFuzzer saves alone. The child's
+// coverage counters are copied back for libFuzzer to see.
+//
+// AddressSanitizer catches reads and writes outside buffers, which show up as
+// crashes. The firmware halting (see haltStr6() in main.cpp) is how it's
+// designed to deal with things it doesn't understand, so that isn't one -
+// random input halts it within a few operations. Instead, each new reason for
+// halting is printed as it's found, and how often each happened is printed at
+// the end.
+
+void setup();
+void loop();
+
+static const uint32_t sCyclesPerFrame = F_CPU / 1000;
+
+// The exit status of a child that halted.
+static const int sHaltedStatus = 99;
+
+// Shared with the children.
+struct FuzzResult {
+    char haltLine[64];
+    uint8_t haltLineLength;
+    bool halted;
+};
+static FuzzResult *sResult;
+static uint8_t *sCounters;
+
+// libFuzzer's coverage counters ('inline-8bit-counters'). The linker makes
+// these, if there are any.
+extern "C" {
+    extern uint8_t __start___sancov_cntrs[] __attribute__((weak));
+    extern uint8_t __stop___sancov_cntrs[] __attribute__((weak));
+}
+
+static size_t countersSize()
+{
+    return __start___sancov_cntrs ? __stop___sancov_cntrs - __start___sancov_cntrs : 0;
+}
+
+// Keeps the line the firmware printed when it halted - '...HALT: 0x.. reason'
+// (debug output may come first) - and throws away the rest of its serial
+// output.
+static void recordSerialOutput(const uint8_t ch)
+{
+    if(sResult->halted) {
+        return;
+    }
+    char *line = sResult->haltLine;
+    if(ch == '\n') {
+        line[sResult->haltLineLength] = '\0';
+        const char *halt = strstr(line, "HALT");
+        if(halt) {
+            sResult->haltLineLength = strlen(halt);
+            memmove(line, halt, sResult->haltLineLength + 1);
+            sResult->halted = true;
+        } else {
+            sResult->haltLineLength = 0;
+        }
+        return;
+    }
+    if(sResult->haltLineLength == sizeof(sResult->haltLine) - 1) {
+        // Keep the end of long lines.
+        memmove(line, line + 1, sResult->haltLineLength - 1);
+        --sResult->haltLineLength;
+    }
+    line[sResult->haltLineLength++] = ch;
+}
+
+static void childFinished(const int status)
+{
+    if(countersSize()) {
+        memcpy(sCounters, __start___sancov_cntrs, countersSize());
+    }
+    _exit(status);
+}
+
+static void childHalted()
+{
+    childFinished(sHaltedStatus);
+}
+
+// How many times the firmware halted, for each reason.
+struct HaltCount {
+    char line[sizeof(FuzzResult::haltLine)];
+    uint32_t count;
+};
+static const uint8_t sHaltCountsLength = 32;
+static HaltCount sHaltCounts[sHaltCountsLength];
+static uint32_t sInputCount = 0;
+
+static void countHalt()
+{
+    // Count by reason, whatever the number before it.
+    const char *reason = sResult->haltLine;
+    static const char prefix[] = "HALT: 0X";
+    if(!sResult->halted) {
+        reason = "(Nothing printed)";
+    } else if(strncmp(reason, prefix, sizeof(prefix) - 1) == 0 && strlen(reason) > sizeof(prefix) + 2) {
+        reason += sizeof(prefix) + 2;
+    }
+
+    uint8_t i = 0;
+    for(; i < sHaltCountsLength && sHaltCounts[i].count; ++i) {
+        if(strcmp(sHaltCounts[i].line, reason) == 0) {
+            ++sHaltCounts[i].count;
+            return;
+        }
+    }
+    if(i == sHaltCountsLength) {
+        // Out of room - lump the rest in with the last.
+        ++sHaltCounts[i - 1].count;
+        return;
+    }
+    strcpy(sHaltCounts[i].line, reason);
+    sHaltCounts[i].count = 1;
+    fprintf(stderr, "fuzzUsbOut: New halt: %s\n", sResult->haltLine);
+}
+
+static void printHaltCounts()
+{
+    fprintf(stderr, "fuzzUsbOut: %u inputs. Halts:\n", (unsigned)sInputCount);
+    for(uint8_t i = 0; i < sHaltCountsLength && sHaltCounts[i].count; ++i) {
+        fprintf(stderr, "%10u  %s\n", (unsigned)sHaltCounts[i].count, sHaltCounts[i].line);
+    }
+}
+
+static void runUntilTaken(bool (*send)(const uint8_t *data, uint8_t length), const uint8_t *data, const uint8_t length)
+{
+    // The firmware takes one packet per usbPoll(). It's never too busy for
+    // long, so something's wrong if this takes more than a second.
+    for(uint16_t tries = 0; !send(data, length); ++tries) {
+        if(tries == 1000) {
+            fprintf(stderr, "fuzzUsbOut: The firmware stopped taking packets.\n");
+            abort();
+        }
+        loop();
+        avrHostAdvanceCycles(sCyclesPerFrame);
+    }
+    loop();
+}
+
+static bool sendOut(const uint8_t *data, const uint8_t length)
+{
+    return avrHostUsbSendOut(1, data, length);
+}
+
+static bool sendSetup(const uint8_t *data, const uint8_t length)
+{
+    (void)length;
+    return avrHostUsbSendSetup(data);
+}
+
+static void run(const uint8_t *data, const size_t size)
+{
+    size_t cursor = 0;
+    while(cursor < size) {
+        const uint8_t operation = data[cursor++];
+        if(operation < 0x80) {
+            uint8_t packet[8] = { 0 };
+            uint8_t length = (operation & 0x7) + 1;
+            if(length > size - cursor) {
+                length = size - cursor;
+            }
+            if(length == 0) {
+                break;
+            }
+            memcpy(packet, data + cursor, length);
+            cursor += length;
+            runUntilTaken(sendOut, packet, length);
+        } else if(operation < 0xc0) {
+            static const uint8_t clearEndpointHalt[8] = {
+                USBRQ_TYPE_STANDARD | USBRQ_RCPT_ENDPOINT, USBRQ_CLEAR_FEATURE,
+                0x00, 0x00, // ENDPOINT_HALT
+                0x01, 0x00, // Endpoint 1
+                0x00, 0x00,
+            };
+            runUntilTaken(sendSetup, clearEndpointHalt, sizeof(clearEndpointHalt));
+        } else {
+            for(uint8_t frames = (operation & 0x3f) + 1; frames; --frames) {
+                loop();
+                avrHostAdvanceCycles(sCyclesPerFrame);
+            }
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool started = false;
+    if(!started) {
+        void *shared = mmap(NULL, sizeof(FuzzResult) + countersSize(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(shared == MAP_FAILED) {
+            perror("fuzzUsbOut: mmap");
+            abort();
+        }
+        sResult = (FuzzResult *)shared;
+        sCounters = (uint8_t *)shared + sizeof(FuzzResult);
+        avrHostUartTransmit = recordSerialOutput;
+        avrHostHalted = childHalted;
+        atexit(printHaltCounts);
+
+        dualShockModelAttach();
+        setup();
+
+        // Let USB come up.
+        while(avrHostCycles() < 500 * (uint64_t)sCyclesPerFrame) {
+            loop();
+            avrHostAdvanceCycles(100);
+        }
+        started = true;
+    }
+
+    ++sInputCount;
+    memset(sResult, 0, sizeof(FuzzResult));
+    fflush(NULL);
+    const pid_t child = fork();
+    if(child < 0) {
+        perror("fuzzUsbOut: fork");
+        abort();
+    }
+    if(child == 0) {
+        run(data, size);
+        childFinished(0);
+    }
+
+    int status;
+    while(waitpid(child, &status, 0) < 0) {
+        if(errno != EINTR) {
+            perror("fuzzUsbOut: waitpid");
+            abort();
+        }
+    }
+    if(countersSize()) {
+        memcpy(__start___sancov_cntrs, sCounters, countersSize());
+    }
+
+    if(WIFEXITED(status) && WEXITSTATUS(status) == sHaltedStatus) {
+        countHalt();
+    } else if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        // What went wrong has been printed already. Crash too, so libFuzzer
+        // saves the input.
+        fprintf(stderr, "fuzzUsbOut: The input crashed the firmware.\n");
+        abort();
+    }
+    return 0;
+}
+
+#endif
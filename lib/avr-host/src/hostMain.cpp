@@ -0,0 +1,110 @@
+#include <avrHost.h>
+
+#if !AVR_HOST_FUZZ && !AVR_HOST_RUMBLE_CHECK && !AVR_HOST_PACKED_STRING_BENCH && !defined(PIO_UNIT_TESTING)
+
+#include <dualShockModel.h>
+#include <usbReplay.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+    #include <usbdrv/usbdrv.h>
+}
+
+// The host build's `main()`, used unless the program has its own. It runs the
+// firmware, plugged into USB with a pretend Dual Shock attached, for the given
+// number of (emulated) milliseconds - 1000 by default - with its serial output
+// on stdout and the USB packets it sends and receives on stderr.
+//
+// Options, after the time:
+//   --no-dual-shock  Leave the Dual Shock unplugged.
+//   --faults         Make the Dual Shock misbehave every 100ms, in turn
+//                    dropping an ACK, sending a bad header and dropping to
+//                    digital mode.
+//   --replay FILE    Send the Switch's side of a recording (see usbReplay.h).
+//                    `replay_switch_traffic.py` uses this.
+
+void setup();
+void loop();
+
+static void printPacket(const char *kind, const uint8_t *data, const uint8_t length)
+{
+    fprintf(stderr, "%10.3fms %s:", avrHostCycles() / (F_CPU / 1000.0), kind);
+    for(uint8_t i = 0; i < length; ++i) {
+        fprintf(stderr, " %02X", data[i]);
+    }
+    fputc('\n', stderr);
+}
+
+static void printInterruptPacket(const uint8_t *data, const uint8_t length)
+{
+    printPacket("IN", data, length);
+    usbReplayInterruptCollected(data, length);
+}
+
+static void printReplayedPacket(const uint8_t token, const uint8_t *data, const uint8_t length)
+{
+    printPacket(token == USBPID_SETUP ? "SETUP" : "OUT", data, length);
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned long millis = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+    const uint64_t endCycles = (uint64_t)millis * (F_CPU / 1000);
+
+    bool dualShock = true;
+    bool faults = false;
+    for(int i = 2; i < argc; ++i) {
+        if(strcmp(argv[i], "--no-dual-shock") == 0) {
+            dualShock = false;
+        } else if(strcmp(argv[i], "--faults") == 0) {
+            faults = true;
+        } else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if(!usbReplayLoad(argv[++i])) {
+                return 1;
+            }
+            usbReplayPacketSent = printReplayedPacket;
+        } else {
+            fprintf(stderr, "Usage: %s [milliseconds] [--no-dual-shock] [--faults] [--replay FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    avrHostUsbInterruptCollected = printInterruptPacket;
+    if(dualShock) {
+        dualShockModelAttach();
+    }
+
+    const uint64_t cyclesPerFault = 100 * (F_CPU / 1000);
+    uint64_t nextFaultCycles = cyclesPerFault;
+    uint8_t nextFault = 0;
+
+    setup();
+    while(avrHostCycles() < endCycles) {
+        usbReplayStep();
+        loop();
+
+        // The main loop itself takes no emulated time, so if it didn't sleep
+        // or wait for anything, count a little for it.
+        avrHostAdvanceCycles(100);
+
+        if(faults && avrHostCycles() >= nextFaultCycles) {
+            dualShockModelInjectFault((DualShockModelFault)nextFault);
+            nextFault = (nextFault + 1) % 3;
+            nextFaultCycles += cyclesPerFault;
+        }
+    }
+
+    if(dualShock) {
+        fprintf(stderr, "Dual Shock: mode %02X, %lu transactions, %lu abandoned, motors %s/%02X\n",
+            dualShockModelMode(),
+            (unsigned long)dualShockModelTransactionCount(),
+            (unsigned long)dualShockModelAbandonedCount(),
+            dualShockModelSmallMotorOn() ? "on" : "off",
+            dualShockModelLargeMotor());
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include <avrHost.h>
+
+#if AVR_HOST_PACKED_STRING_BENCH
+
+#include "packedStrings.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+extern "C" {
+    uint32_t avrHostProgramMemoryByteReads = 0;
+}
+
+// Compares decoding packed strings a character at a time with
+// `str6CharAtIndex()`/`str7CharAtIndex()` (as serialPrintStr6() used to)
+// against reading them through a PackedStringReader. This is the
+// 'nativePackedStringBench' environment's `main()`:
+//
+//   program [ROUNDS]
+//
+// It checks both give the same characters for each of the strings the
+// firmware prints, then decodes them all ROUNDS times (100000 by default)
+// each way, and prints how many bytes of program memory each read, and how
+// long each took, per character.
+//
+// The host isn't an AVR - it has a barrel shifter, and reading 'program
+// memory' is as cheap as any other load - so the times don't say much about
+// the chip. The reads do: each is an `lpm`, and the address arithmetic
+// around it. The ATmega8Benchmark build's benchmarks (see src/benchmark.h)
+// count the real cycles.
+
+static const uint8_t sMaxStrings = 64;
+
+struct PackedStrings {
+    const uint8_t *strings[sMaxStrings];
+    uint8_t count;
+};
+
+#define ADD(str) strings->strings[strings->count++] = bitsPerChar == 6 ? STR6(str) : STR7(str)
+
+// Everything passed to STR6() in src/, at the time of writing.
+static void addFirmwareStrings(PackedStrings *strings, const uint8_t bitsPerChar)
+{
+    strings->count = 0;
+    ADD(" <");
+    ADD(" Bad SPI");
+    ADD(" Rumble");
+    ADD(" Rumble: (");
+    ADD(" [FPS: ");
+    ADD(" [SO: ");
+    ADD(" disabled");
+    ADD(" enabled");
+    ADD("> SPI:\n");
+    ADD("?\n");
+    ADD("Awake\n");
+    ADD("BENCH ");
+    ADD("BENCH END\n");
+    ADD("Bad 'regular' subcommand");
+    ADD("Bad CRC");
+    ADD("Bad UART subcommand");
+    ADD("Bad report ID");
+    ADD("Bad rumble length");
+    ADD("Benchmark\n");
+    ADD("Cleared\n");
+    ADD("DELIVERY ");
+    ADD("EEPROM\n");
+    ADD("END\n");
+    ADD("HALT: 0x");
+    ADD("HANDOFF ");
+    ADD("INTERVAL ");
+    ADD("OK\n");
+    ADD("Report Clash");
+    ADD("Report Too Big");
+    ADD("SO ");
+    ADD("\n!CLR HALT ");
+    ADD("\n/ -> ");
+    ADD("\n< SPI:\n");
+    ADD("\nACK\n");
+    ADD("\nBENCH START\n");
+    ADD("\nEND\n");
+    ADD("\nFLIGHT\n");
+    ADD("\nLATENCY ");
+    ADD("\nTRACE\n");
+    ADD("\nUSB Down\n");
+    ADD("\nUSB Up\n");
+    ADD("\n\\ ");
+    ADD("\n\nBad setup transaction. Data: ");
+    ADD("\n| ...");
+    ADD("] [MA: ");
+    ADD("] [OSC: ");
+}
+
+#undef ADD
+
+// Both return the number of characters decoded, and add them all up in
+// `sum`, so the compiler can't skip anything.
+
+static uint32_t decodeAtIndex(const PackedStrings *strings, const uint8_t bitsPerChar, uint32_t *sum)
+{
+    uint32_t characters = 0;
+    for(uint8_t i = 0; i < strings->count; ++i) {
+        uint8_t ch;
+        uint8_t index = 0;
+        while((ch = bitsPerChar == 6 ? str6CharAtIndex(strings->strings[i], index) : str7CharAtIndex(strings->strings[i], index)) != 0) {
+            *sum += ch;
+            ++index;
+        }
+        characters += index;
+    }
+    return characters;
+}
+
+static uint32_t decodeWithReader(const PackedStrings *strings, const uint8_t bitsPerChar, uint32_t *sum)
+{
+    uint32_t characters = 0;
+    for(uint8_t i = 0; i < strings->count; ++i) {
+        PackedStringReader reader;
+        packedStringReaderInit(&reader, strings->strings[i]);
+        uint8_t ch;
+        while((ch = bitsPerChar == 6 ? str6ReadChar(&reader) : str7ReadChar(&reader)) != 0) {
+            *sum += ch;
+            ++characters;
+        }
+    }
+    return characters;
+}
+
+static bool check(const PackedStrings *strings, const uint8_t bitsPerChar)
+{
+    bool ok = true;
+    for(uint8_t i = 0; i < strings->count; ++i) {
+        PackedStringReader reader;
+        packedStringReaderInit(&reader, strings->strings[i]);
+        uint8_t index = 0;
+        uint8_t expected;
+        do {
+            expected = bitsPerChar == 6 ? str6CharAtIndex(strings->strings[i], index) : str7CharAtIndex(strings->strings[i], index);
+            const uint8_t read = bitsPerChar == 6 ? str6ReadChar(&reader) : str7ReadChar(&reader);
+            if(read != expected) {
+                printf("STR%u string %u, character %u: %02X by index, %02X from the reader\n", bitsPerChar, i, index, expected, read);
+                ok = false;
+                break;
+            }
+            ++index;
+        } while(expected != 0);
+    }
+    return ok;
+}
+
+static double secondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+struct DecodeCost {
+    double bytesRead;
+    double nanoseconds;
+};
+
+static DecodeCost measure(uint32_t (*decode)(const PackedStrings *, uint8_t, uint32_t *), const PackedStrings *strings, const uint8_t bitsPerChar, const uint32_t rounds, uint32_t *sum)
+{
+    avrHostProgramMemoryByteReads = 0;
+    const uint32_t characters = decode(strings, bitsPerChar, sum);
+    DecodeCost cost;
+    cost.bytesRead = (double)avrHostProgramMemoryByteReads / characters;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t round = 0; round < rounds; ++round) {
+        decode(strings, bitsPerChar, sum);
+    }
+    cost.nanoseconds = secondsSince(&start) * 1e9 / ((double)characters * rounds);
+    return cost;
+}
+
+int main(int argc, char **argv)
+{
+    const uint32_t rounds = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+
+    bool ok = true;
+    uint32_t sum = 0;
+    for(uint8_t bitsPerChar = 6; bitsPerChar <= 7; ++bitsPerChar) {
+        PackedStrings strings;
+        addFirmwareStrings(&strings, bitsPerChar);
+        if(!check(&strings, bitsPerChar)) {
+            ok = false;
+            continue;
+        }
+
+        const uint32_t characters = decodeWithReader(&strings, bitsPerChar, &sum);
+        const DecodeCost atIndex = measure(decodeAtIndex, &strings, bitsPerChar, rounds, &sum);
+        const DecodeCost reader = measure(decodeWithReader, &strings, bitsPerChar, rounds, &sum);
+        printf("STR%u: %u strings, %u characters. Per character:\n", bitsPerChar, strings.count, (unsigned)characters);
+        printf("  str%uCharAtIndex: %.2f bytes read, %.2fns\n", bitsPerChar, atIndex.bytesRead, atIndex.nanoseconds);
+        printf("  str%uReadChar:    %.2f bytes read, %.2fns\n", bitsPerChar, reader.bytesRead, reader.nanoseconds);
+    }
+
+    // (So `sum` is used.)
+    fprintf(stderr, "(%08X)\n", (unsigned)sum);
+    return ok ? 0 : 1;
+}
+
+#endif
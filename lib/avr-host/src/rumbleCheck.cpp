@@ -0,0 +1,417 @@
+#include <avrHost.h>
+
+#if AVR_HOST_RUMBLE_CHECK
+
+#include "rumble.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Checks `decodeSwitchRumbleState()`, so that it can be rewritten (e.g. to be
+// faster) without changing what it does. This is the 'nativeRumbleCheck'
+// environment's `main()`:
+//
+//   program decode CORPUS
+//     Decodes each encoding in a corpus file (four hex bytes per line, `#`
+//     starts a comment - see replays/rumble_corpus.txt) and prints the
+//     results, one line each. Redirect it to make a golden file.
+//   program check CORPUS GOLDEN
+//     Decodes the corpus, and compares the results with the golden file -
+//     e.g. `check replays/rumble_corpus.txt replays/rumble_corpus.txt.golden`.
+//   program exhaustive [FIRST [LAST]]
+//     Decodes every possible encoding - all 2^32, unless told otherwise - and
+//     compares each with the reference decoder below. Also times both.
+//
+// The reference decoder does exactly what rumble.cpp's does, but is written
+// with shifts and masks on the whole 32-bit encoding, rather than with
+// bitfields on a flipped copy of it - so it doesn't depend on how the
+// compiler lays out bitfields, and can stay as it is when rumble.cpp changes.
+
+// The encoding as a little-endian word, bit-reversed. This puts the type at
+// the bottom, and each field where rumble.cpp's bitfields have it.
+static uint32_t flipped(const uint8_t *encoded)
+{
+    const uint32_t word = encoded[0] | encoded[1] << 8 | encoded[2] << 16 | (uint32_t)encoded[3] << 24;
+    uint32_t reversed = 0;
+    for(uint8_t i = 0; i < 32; ++i) {
+        reversed |= ((word >> i) & 1) << (31 - i);
+    }
+    return reversed;
+}
+
+static uint8_t field(const uint32_t flipped, const uint8_t offset, const uint8_t width)
+{
+    return (flipped >> offset) & ((1 << width) - 1);
+}
+
+static uint8_t reverse7(const uint8_t value)
+{
+    uint8_t reversed = 0;
+    for(uint8_t i = 0; i < 7; ++i) {
+        reversed |= ((value >> i) & 1) << (6 - i);
+    }
+    return reversed;
+}
+
+static uint8_t referenceAmplitude4(const uint8_t value)
+{
+    static const uint8_t amplitudes[16] = {
+        (uint8_t)(0 * 0xff),
+        (uint8_t)(1 * 0xff),
+        (uint8_t)(0.713429339 * 0xff),
+        (uint8_t)(0.510491764 * 0xff),
+        (uint8_t)(0.364076932 * 0xff),
+        (uint8_t)(0.263212876 * 0xff),
+        (uint8_t)(0.187285343 * 0xff),
+        (uint8_t)(0.128740086 * 0xff),
+        (uint8_t)(0.096642284 * 0xff),
+        (uint8_t)(0.065562582 * 0xff),
+        (uint8_t)(0.047502641 * 0xff),
+        (uint8_t)(0.035863824 * 0xff),
+    };
+    return amplitudes[value];
+}
+
+static uint8_t referenceAmplitude7(const uint8_t value)
+{
+    return value << 1;
+}
+
+static uint8_t referenceLowFrequency(const uint8_t value)
+{
+    return reverse7(value);
+}
+
+static uint8_t referenceHighFrequency(const uint8_t value)
+{
+    return reverse7(value) + 32;
+}
+
+enum Type {
+    TYPE_X0,
+    TYPE_0100,
+    TYPE_0101,
+    TYPE_0110,
+    TYPE_0111,
+    TYPE_11,
+};
+
+static Type typeOf(const uint8_t *encoded)
+{
+    switch(encoded[3] >> 6) {
+        case 0b00:
+        case 0b10:
+            return TYPE_X0;
+        case 0b01:
+            return (Type)(TYPE_0100 + (encoded[0] & 0b11));
+        default:
+            return TYPE_11;
+    }
+}
+
+static const char *typeName(const uint8_t *encoded)
+{
+    // (0111 isn't a known encoding.)
+    static const char *const names[] = { "X0", "0100", "0101", "0110", "0111", "11" };
+    return names[typeOf(encoded)];
+}
+
+static void setFrequencies(SwitchRumbleState *state, const uint8_t low, const uint8_t high, const uint8_t pulse)
+{
+#if RUMBLE_INCLUDE_FREQUENCY
+    if(low) {
+        state->lowChannelFrequency = low;
+    }
+    if(high) {
+        state->highChannelFrequency = high;
+    }
+    if(pulse) {
+        state->pulseFrequency = pulse;
+    }
+#else
+    (void)state;
+    (void)low;
+    (void)high;
+    (void)pulse;
+#endif
+}
+
+static void referenceDecode(const uint8_t *encoded, SwitchRumbleState *state)
+{
+    memset(state, 0, sizeof(*state));
+    const uint32_t f = flipped(encoded);
+    const Type type = typeOf(encoded);
+
+    if(type == TYPE_X0) {
+        const bool highLowSelect = field(f, 24, 1);
+        const uint8_t frequency = field(f, 25, 7);
+        if(highLowSelect) {
+            const uint8_t high = referenceHighFrequency(frequency);
+            setFrequencies(state, RUMBLE_FREQUENCY_160HZ, high, high);
+        } else {
+            const uint8_t low = referenceLowFrequency(frequency);
+            setFrequencies(state, low, RUMBLE_FREQUENCY_320HZ, low);
+        }
+        if(!field(f, 19, 1) && highLowSelect && frequency != 0) {
+            state->highChannelAmplitude = referenceAmplitude4(field(f, 20, 4));
+        }
+        if(!field(f, 14, 1) && !highLowSelect && frequency != 0) {
+            state->lowChannelAmplitude = referenceAmplitude4(field(f, 15, 4));
+        }
+        if(!field(f, 9, 1)) {
+            state->pulse1Amplitude = referenceAmplitude4(field(f, 10, 4));
+        }
+        state->pulse2Amplitude = referenceAmplitude7(field(f, 2, 7));
+    } else if(type == TYPE_0100) {
+        setFrequencies(state, referenceLowFrequency(field(f, 9, 7)), referenceHighFrequency(field(f, 23, 7)), 0);
+        state->lowChannelAmplitude = referenceAmplitude7(field(f, 2, 7));
+        state->highChannelAmplitude = referenceAmplitude7(field(f, 16, 7));
+    } else if(type == TYPE_0110) {
+        setFrequencies(state, 0, 0, RUMBLE_FREQUENCY_226HZ);
+        if(!field(f, 24, 1)) {
+            setFrequencies(state, 0, RUMBLE_FREQUENCY_320HZ, 0);
+            state->highChannelAmplitude = referenceAmplitude4(field(f, 25, 4));
+        }
+        if(!field(f, 19, 1)) {
+            setFrequencies(state, RUMBLE_FREQUENCY_160HZ, 0, 0);
+            state->lowChannelAmplitude = referenceAmplitude4(field(f, 20, 4));
+        }
+        if(!field(f, 14, 1)) {
+            state->pulse1Amplitude = referenceAmplitude4(field(f, 15, 4));
+        }
+        if(!field(f, 9, 1)) {
+            state->pulse2Amplitude = referenceAmplitude4(field(f, 10, 4));
+        }
+        state->pulse3Amplitude = referenceAmplitude7(field(f, 2, 7));
+    } else if(type == TYPE_11) {
+        setFrequencies(state, 0, 0, RUMBLE_FREQUENCY_226HZ);
+        const bool pulse1Or400HzOn = !field(f, 17, 1);
+        const uint8_t pulse1Or400HzAmplitude = referenceAmplitude4(field(f, 18, 4));
+        if(!field(f, 27, 1)) {
+            setFrequencies(state, 0, RUMBLE_FREQUENCY_320HZ, 0);
+            state->highChannelAmplitude = referenceAmplitude4(field(f, 28, 4));
+            if(pulse1Or400HzOn) {
+                state->pulse1Amplitude = pulse1Or400HzAmplitude;
+            }
+        } else if(pulse1Or400HzOn) {
+            setFrequencies(state, 0, RUMBLE_FREQUENCY_400HZ, 0);
+            state->highChannelAmplitude = pulse1Or400HzAmplitude;
+        }
+        if(!field(f, 22, 1)) {
+            setFrequencies(state, RUMBLE_FREQUENCY_160HZ, 0, 0);
+            state->lowChannelAmplitude = referenceAmplitude4(field(f, 23, 4));
+        }
+        if(!field(f, 12, 1)) {
+            state->pulse2Amplitude = referenceAmplitude4(field(f, 13, 4));
+        }
+        if(!field(f, 7, 1)) {
+            state->pulse3Amplitude = referenceAmplitude4(field(f, 8, 4));
+        }
+        if(!field(f, 2, 1)) {
+            state->pulse4Amplitude = referenceAmplitude4(field(f, 3, 4));
+        }
+    }
+    // (The silent and unrecognised types decode to nothing.)
+}
+
+static void formatState(char *line, const size_t size, const uint8_t *encoded, const SwitchRumbleState *state)
+{
+#if RUMBLE_INCLUDE_FREQUENCY
+    snprintf(line, size, "%02X %02X %02X %02X  %-4s  freq %02X %02X %02X  amp %02X %02X  pulses %02X %02X %02X %02X\n",
+        encoded[0], encoded[1], encoded[2], encoded[3], typeName(encoded),
+        state->lowChannelFrequency, state->highChannelFrequency, state->pulseFrequency,
+        state->lowChannelAmplitude, state->highChannelAmplitude,
+        state->pulse1Amplitude, state->pulse2Amplitude, state->pulse3Amplitude, state->pulse4Amplitude);
+#else
+    snprintf(line, size, "%02X %02X %02X %02X  %-4s  amp %02X %02X  pulses %02X %02X %02X %02X\n",
+        encoded[0], encoded[1], encoded[2], encoded[3], typeName(encoded),
+        state->lowChannelAmplitude, state->highChannelAmplitude,
+        state->pulse1Amplitude, state->pulse2Amplitude, state->pulse3Amplitude, state->pulse4Amplitude);
+#endif
+}
+
+// Calls `decoded` with each line of the corpus, decoded. Returns false if the
+// corpus can't be read.
+static bool decodeCorpus(const char *path, bool (*decoded)(const char *line, void *context), void *context)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        perror(path);
+        return false;
+    }
+
+    char line[256];
+    unsigned lineNumber = 0;
+    while(fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        char *comment = strchr(line, '#');
+        if(comment) {
+            *comment = '\0';
+        }
+
+        unsigned bytes[4];
+        char extra;
+        const int fields = sscanf(line, "%x %x %x %x %c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &extra);
+        if(fields <= 0) {
+            continue;
+        }
+        if(fields != 4 || bytes[0] > 0xff || bytes[1] > 0xff || bytes[2] > 0xff || bytes[3] > 0xff) {
+            fprintf(stderr, "%s:%u: Expected four hex bytes.\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+
+        const uint8_t encoded[4] = { (uint8_t)bytes[0], (uint8_t)bytes[1], (uint8_t)bytes[2], (uint8_t)bytes[3] };
+        SwitchRumbleState state;
+        decodeSwitchRumbleState(encoded, &state);
+        formatState(line, sizeof(line), encoded, &state);
+        if(!decoded(line, context)) {
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool printDecoded(const char *line, void *context)
+{
+    (void)context;
+    fputs(line, stdout);
+    return true;
+}
+
+struct GoldenCheck {
+    FILE *golden;
+    unsigned lineNumber;
+    unsigned mismatches;
+};
+
+static bool checkDecoded(const char *line, void *context)
+{
+    GoldenCheck *check = (GoldenCheck *)context;
+    ++check->lineNumber;
+
+    char expected[256];
+    if(!fgets(expected, sizeof(expected), check->golden)) {
+        strcpy(expected, "(nothing)\n");
+    }
+    if(strcmp(line, expected) != 0) {
+        if(++check->mismatches <= 10) {
+            printf("Line %u:\n  expected %s  decoded  %s", check->lineNumber, expected, line);
+        }
+    }
+    return true;
+}
+
+static double secondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int exhaustive(const uint32_t first, const uint32_t last)
+{
+    uint64_t mismatches = 0;
+    double decodeSeconds = 0;
+    double referenceSeconds = 0;
+
+    // In blocks, so the timing overhead doesn't count for much.
+    static const uint32_t blockSize = 1 << 16;
+    static SwitchRumbleState decoded[blockSize];
+    static SwitchRumbleState expected[blockSize];
+
+    uint64_t encoding = first;
+    while(encoding <= last) {
+        const uint32_t count = (last - encoding + 1 < blockSize) ? (uint32_t)(last - encoding + 1) : blockSize;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(uint32_t i = 0; i < count; ++i) {
+            const uint32_t value = (uint32_t)(encoding + i);
+            const uint8_t encoded[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+            decodeSwitchRumbleState(encoded, &decoded[i]);
+        }
+        decodeSeconds += secondsSince(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(uint32_t i = 0; i < count; ++i) {
+            const uint32_t value = (uint32_t)(encoding + i);
+            const uint8_t encoded[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+            referenceDecode(encoded, &expected[i]);
+        }
+        referenceSeconds += secondsSince(&start);
+
+        for(uint32_t i = 0; i < count; ++i) {
+            if(memcmp(&decoded[i], &expected[i], sizeof(SwitchRumbleState)) != 0) {
+                if(++mismatches <= 10) {
+                    const uint32_t value = (uint32_t)(encoding + i);
+                    const uint8_t encoded[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+                    char line[256];
+                    formatState(line, sizeof(line), encoded, &expected[i]);
+                    printf("Mismatch:\n  expected %s", line);
+                    formatState(line, sizeof(line), encoded, &decoded[i]);
+                    printf("  decoded  %s", line);
+                }
+            }
+        }
+
+        encoding += count;
+        if((encoding & 0xfffffff) == 0) {
+            fprintf(stderr, "%08llX...\n", (unsigned long long)encoding);
+        }
+    }
+
+    const double samples = (double)last - first + 1;
+    printf("%.0f encodings, %llu mismatches\n", samples, (unsigned long long)mismatches);
+    printf("decodeSwitchRumbleState: %.2fns each\n", decodeSeconds * 1e9 / samples);
+    printf("reference:               %.2fns each\n", referenceSeconds * 1e9 / samples);
+    return mismatches ? 1 : 0;
+}
+
+static void discardSerialOutput(const uint8_t ch)
+{
+    (void)ch;
+}
+
+int main(int argc, char **argv)
+{
+    // (The decoder's debug output would get mixed up with ours.)
+    avrHostUartTransmit = discardSerialOutput;
+
+    if(argc == 3 && strcmp(argv[1], "decode") == 0) {
+        return decodeCorpus(argv[2], printDecoded, NULL) ? 0 : 1;
+    }
+    if(argc == 4 && strcmp(argv[1], "check") == 0) {
+        GoldenCheck check = { fopen(argv[3], "r"), 0, 0 };
+        if(!check.golden) {
+            perror(argv[3]);
+            return 1;
+        }
+        if(!decodeCorpus(argv[2], checkDecoded, &check)) {
+            return 1;
+        }
+        char extra[256];
+        if(fgets(extra, sizeof(extra), check.golden)) {
+            printf("The golden file has more lines than the corpus.\n");
+            ++check.mismatches;
+        }
+        fclose(check.golden);
+        printf("%u encodings, %u mismatches\n", check.lineNumber, check.mismatches);
+        return check.mismatches ? 1 : 0;
+    }
+    if(argc >= 2 && argc <= 4 && strcmp(argv[1], "exhaustive") == 0) {
+        const uint32_t first = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+        const uint32_t last = argc > 3 ? strtoul(argv[3], NULL, 0) : 0xffffffff;
+        return exhaustive(first, last);
+    }
+
+    fprintf(stderr, "Usage:\n"
+                    "  %s decode CORPUS\n"
+                    "  %s check CORPUS GOLDEN\n"
+                    "  %s exhaustive [FIRST [LAST]]\n", argv[0], argv[0], argv[0]);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include <usbReplay.h>
+#include <avrHost.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+    #include <usbdrv/usbdrv.h>
+}
+
+static const uint8_t sReportSize = 64;
+static const uint8_t sOutEndpoint = 1;
+
+typedef struct Transfer {
+    uint32_t millis;
+    bool relative;
+    uint8_t token;
+    uint8_t length;
+    uint8_t data[sReportSize];
+} Transfer;
+
+static Transfer *sTransfers = NULL;
+static size_t sTransferCount = 0;
+
+// Where we are.
+static size_t sTransferIndex = 0;
+static uint8_t sTransferCursor = 0;
+static uchar sLastPacketSofCount;
+static bool sSentAPacket = false;
+
+// When the last transfer was finished with - i.e. sent, and replied to if
+// it needed a reply.
+static uint64_t sFinishedCycles = 0;
+static bool sAwaitingReply = false;
+
+// The report the firmware's sending.
+static uint8_t sInReportId;
+static uint8_t sInReportLength = 0;
+
+static void noPacketSentCallback(const uint8_t token, const uint8_t *data, const uint8_t length)
+{
+    (void)token;
+    (void)data;
+    (void)length;
+}
+
+void (*usbReplayPacketSent)(uint8_t token, const uint8_t *data, uint8_t length) = noPacketSentCallback;
+
+static bool parseLine(char *line, Transfer *transfer)
+{
+    char *cursor = line;
+    transfer->relative = (*cursor == '+');
+    if(transfer->relative) {
+        ++cursor;
+    }
+    transfer->millis = strtoul(cursor, &cursor, 10);
+    while(isspace((unsigned char)*cursor)) {
+        ++cursor;
+    }
+
+    uint8_t maximumLength;
+    if(strncmp(cursor, "OUT", 3) == 0) {
+        transfer->token = sOutEndpoint;
+        maximumLength = sReportSize;
+        cursor += 3;
+    } else if(strncmp(cursor, "SETUP", 5) == 0) {
+        transfer->token = USBPID_SETUP;
+        maximumLength = 8;
+        cursor += 5;
+    } else {
+        return false;
+    }
+
+    memset(transfer->data, 0, sizeof(transfer->data));
+    transfer->length = 0;
+    while(true) {
+        char *end;
+        const unsigned long byte = strtoul(cursor, &end, 16);
+        if(end == cursor) {
+            break;
+        }
+        if(byte > 0xff || transfer->length == maximumLength) {
+            return false;
+        }
+        transfer->data[transfer->length++] = (uint8_t)byte;
+        cursor = end;
+    }
+    while(isspace((unsigned char)*cursor)) {
+        ++cursor;
+    }
+    if(*cursor != '\0') {
+        return false;
+    }
+
+    if(transfer->token == USBPID_SETUP) {
+        return transfer->length == 8;
+    }
+    // The Switch always sends whole reports.
+    transfer->length = sReportSize;
+    return true;
+}
+
+static bool expectsReply(const Transfer *transfer)
+{
+    if(transfer->token == USBPID_SETUP) {
+        return false;
+    }
+    switch(transfer->data[0]) {
+        case 0x80:
+            // (0x04 and 0x05 start and stop input reports, with no reply.)
+            return transfer->data[1] >= 0x01 && transfer->data[1] <= 0x03;
+        case 0x01:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool usbReplayLoad(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        perror(path);
+        return false;
+    }
+
+    char line[512];
+    unsigned lineNumber = 0;
+    size_t capacity = 0;
+    while(fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+
+        char *comment = strchr(line, '#');
+        if(comment) {
+            *comment = '\0';
+        }
+        char *cursor = line;
+        while(isspace((unsigned char)*cursor)) {
+            ++cursor;
+        }
+        if(*cursor == '\0') {
+            continue;
+        }
+
+        if(sTransferCount == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            sTransfers = (Transfer *)realloc(sTransfers, capacity * sizeof(Transfer));
+            if(!sTransfers) {
+                abort();
+            }
+        }
+        if(!parseLine(cursor, &sTransfers[sTransferCount])) {
+            fprintf(stderr, "%s:%u: Can't understand this line.\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+        ++sTransferCount;
+    }
+    fclose(file);
+
+    sTransferIndex = 0;
+    sTransferCursor = 0;
+    return true;
+}
+
+void usbReplayStep()
+{
+    if(usbReplayFinished()) {
+        return;
+    }
+
+    const Transfer *transfer = &sTransfers[sTransferIndex];
+    const uint64_t cycles = (uint64_t)transfer->millis * (F_CPU / 1000);
+    if(transfer->relative) {
+        if(sAwaitingReply || avrHostCycles() < sFinishedCycles + cycles) {
+            return;
+        }
+    } else if(avrHostCycles() < cycles) {
+        return;
+    }
+    if(sSentAPacket && usbSofCount == sLastPacketSofCount) {
+        return;
+    }
+
+    const uint8_t *packet = transfer->data + sTransferCursor;
+    bool sent;
+    uint8_t packetLength;
+    if(transfer->token == USBPID_SETUP) {
+        packetLength = 8;
+        sent = avrHostUsbSendSetup(packet);
+    } else {
+        const uint8_t remaining = transfer->length - sTransferCursor;
+        packetLength = remaining < 8 ? remaining : 8;
+        sent = avrHostUsbSendOut(transfer->token, packet, packetLength);
+    }
+
+    if(sent) {
+        sSentAPacket = true;
+        sLastPacketSofCount = usbSofCount;
+        usbReplayPacketSent(transfer->token, packet, packetLength);
+        sTransferCursor += packetLength;
+        if(sTransferCursor == transfer->length) {
+            sAwaitingReply = expectsReply(transfer);
+            sFinishedCycles = avrHostCycles();
+            ++sTransferIndex;
+            sTransferCursor = 0;
+        }
+    }
+}
+
+void usbReplayInterruptCollected(const uint8_t *data, const uint8_t length)
+{
+    if(sInReportLength == 0 && length > 0) {
+        sInReportId = data[0];
+    }
+    sInReportLength += length;
+
+    // Like USB, a report ends with a short packet, or when it's full.
+    if(length < 8 || sInReportLength >= sReportSize) {
+        if(sInReportId != 0x30 && sInReportLength > 0 && sAwaitingReply) {
+            // (Anything but a plain input report is a reply.)
+            sAwaitingReply = false;
+            sFinishedCycles = avrHostCycles();
+        }
+        sInReportLength = 0;
+    }
+}
+
+bool usbReplayFinished()
+{
+    return sTransferIndex == sTransferCount;
+}
@@ -0,0 +1,101 @@
+#include <avrHost.h>
+#include <string.h>
+
+// Stands in for V-USB (whose driver is AVR assembly), and the USB host on the
+// other end of it. Only the parts of V-USB's API that the firmware uses are
+// here.
+
+extern "C" {
+    #include <usbdrv/usbdrv.h>
+
+    // The firmware's hook for received data (see USB_RX_USER_HOOK in
+    // usbconfig.h).
+    void usbFunctionRxHook(const uchar *data, const uchar len);
+}
+
+volatile uchar usbSofCount = 0;
+volatile schar usbRxLen = 0;
+uchar usbRxToken;
+usbTxStatus_t usbTxStatus1 = { USBPID_NAK, { 0 } };
+usbTxStatus_t usbTxStatus3 = { USBPID_NAK, { 0 } };
+usbMsgPtr_t usbMsgPtr;
+
+static uchar sRxBuffer[USB_BUFSIZE];
+
+static void noInterruptCollector(const uint8_t *data, uint8_t length)
+{
+    (void)data;
+    (void)length;
+}
+
+void (*avrHostUsbInterruptCollected)(const uint8_t *data, uint8_t length) = noInterruptCollector;
+
+bool avrHostUsbConnected = true;
+
+void avrHostUsbStartOfFrame()
+{
+    ++usbSofCount;
+
+    // The host collects a waiting interrupt IN packet once per frame.
+    if(!usbInterruptIsReady()) {
+        const uchar length = usbTxLen1 - 4;
+        usbTxLen1 = USBPID_NAK;
+        avrHostUsbInterruptCollected(usbTxBuf1, length);
+    }
+}
+
+static bool receive(const uchar token, const uint8_t *data, const uint8_t length)
+{
+    if(usbRxLen != 0 || length == 0 || length > sizeof(sRxBuffer)) {
+        return false;
+    }
+    memcpy(sRxBuffer, data, length);
+    usbRxToken = token;
+    usbRxLen = length;
+    return true;
+}
+
+bool avrHostUsbSendOut(const uint8_t endpoint, const uint8_t *data, const uint8_t length)
+{
+    // Like V-USB, the token for an OUT packet is the endpoint number.
+    return receive(endpoint, data, length);
+}
+
+bool avrHostUsbSendSetup(const uint8_t *request)
+{
+    return receive(USBPID_SETUP, request, 8);
+}
+
+void usbInit(void)
+{
+}
+
+void usbPoll(void)
+{
+    if(usbRxLen > 0) {
+        const uchar length = usbRxLen;
+        usbFunctionRxHook(sRxBuffer, length);
+        if(usbRxToken == USBPID_SETUP) {
+            // V-USB deals with standard requests itself, and we don't pretend
+            // to send any replies.
+            if((sRxBuffer[0] & USBRQ_TYPE_MASK) != USBRQ_TYPE_STANDARD) {
+                usbFunctionSetup(sRxBuffer);
+            }
+        } else {
+            usbFunctionWriteOut(sRxBuffer, length);
+        }
+        usbRxLen = 0;
+    }
+}
+
+void usbSetInterrupt(uchar *data, uchar len)
+{
+    if(len > 8) {
+        len = 8;
+    }
+    memcpy(usbTxBuf1, data, len);
+
+    // V-USB counts the PID and CRC too. Anything without USBPID_NAK's bit 4
+    // set means there's a packet waiting.
+    usbTxLen1 = len + 4;
+}
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+# Replays a recording of what the Switch sends (see lib/avr-host/include/
+# usbReplay.h) to the host build of the firmware, and checks its replies
+# against a golden copy from an earlier run.
+#
+# Usage:
+#   pio run -e native
+#   replay_switch_traffic.py replays/switch_connect.replay [--update]
+#
+# The replies - every report the firmware sends other than plain 0x30 input
+# reports, with their timer byte blanked out - are compared with the
+# recording's .golden file. (The host build always has the same MAC address -
+# see generate_compiletime_mac.py - so the replies that include it can be
+# compared too.) --update writes that file instead. It also prints
+# how long, in frames, the handshake took: from the first packet the Switch
+# sent until the reply to the last command before the rumble stream began.
+
+import argparse
+import difflib
+import os
+import re
+import subprocess
+import sys
+
+project_dir = os.path.dirname(os.path.abspath(__file__))
+default_program = os.path.join(project_dir, '.pio', 'build', 'native', 'program')
+
+report_size = 64
+
+packet_line = re.compile(r'^\s*([0-9.]+)ms (IN|OUT|SETUP):((?: [0-9A-F]{2})*)$')
+transfer_line = re.compile(r'^\s*(\+?\d+)\s+(OUT|SETUP)\b((?:\s+[0-9A-Fa-f]{1,2})*)\s*$')
+
+
+def read_recording(path):
+    transfers = []
+    with open(path, 'r') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            match = transfer_line.match(line)
+            if not match:
+                sys.exit('{}: Can\'t understand "{}"'.format(path, line))
+            millis, kind, data = match.groups()
+            transfers.append((millis, kind, [int(byte, 16) for byte in data.split()]))
+    return transfers
+
+
+def expects_reply(transfer):
+    _, kind, data = transfer
+    if kind != 'OUT' or not data:
+        return False
+    if data[0] == 0x80:
+        # (0x04 and 0x05 start and stop input reports, with no reply.)
+        return len(data) > 1 and data[1] in (0x01, 0x02, 0x03)
+    return data[0] == 0x01
+
+
+def reassemble(packets):
+    # Like USB, a report ends with a short packet, or when it's full.
+    reports = []
+    report = []
+    for millis, data in packets:
+        report += data
+        if len(data) < 8 or len(report) == report_size:
+            reports.append((millis, report))
+            report = []
+    return reports
+
+
+def run(program, recording, millis):
+    try:
+        completed = subprocess.run([program, str(millis), '--replay', recording],
+                                   stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                   errors='replace', timeout=120)
+    except subprocess.TimeoutExpired as e:
+        # A halted firmware never finishes. What it printed says why.
+        output = e.stdout.decode(errors='replace') if e.stdout else ''
+        sys.exit('The firmware stopped responding:\n' + output[-2000:])
+    if completed.returncode != 0:
+        sys.exit(completed.stderr)
+
+    first_out_millis = None
+    in_packets = []
+    for line in completed.stderr.splitlines():
+        match = packet_line.match(line)
+        if not match:
+            continue
+        millis, kind, data = match.groups()
+        millis = float(millis)
+        data = [int(byte, 16) for byte in data.split()]
+        if kind == 'IN':
+            in_packets.append((millis, data))
+        elif first_out_millis is None:
+            first_out_millis = millis
+    return first_out_millis, reassemble(in_packets)
+
+
+def format_reply(report):
+    fields = ['{:02X}'.format(byte) for byte in report]
+    if report[0] in (0x21, 0x30) and len(fields) > 1:
+        # (The timer.)
+        fields[1] = '..'
+    return ' '.join(fields)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('recording')
+    parser.add_argument('--program', default=default_program)
+    parser.add_argument('--golden', help='defaults to the recording, with .golden on the end')
+    parser.add_argument('--update', action='store_true', help='write the golden file rather than checking it')
+    args = parser.parse_args()
+
+    transfers = read_recording(args.recording)
+    if not transfers:
+        sys.exit('Nothing to replay.')
+    golden = args.golden or args.recording + '.golden'
+
+    # Relative times depend on how quickly the firmware replies. Allow it
+    # plenty, and leave time for the last reply.
+    millis = 500
+    for transfer in transfers:
+        if transfer[0].startswith('+'):
+            millis += int(transfer[0]) + (100 if expects_reply(transfer) else 0)
+        else:
+            millis = max(millis, int(transfer[0]) + 500)
+    first_out_millis, reports = run(args.program, args.recording, millis)
+    replies = [(millis, report) for millis, report in reports if report and report[0] != 0x30]
+
+    handshake_replies = 0
+    for transfer in transfers:
+        if transfer[2] and transfer[2][0] == 0x10:
+            break
+        if expects_reply(transfer):
+            handshake_replies += 1
+    if handshake_replies:
+        if len(replies) < handshake_replies:
+            print('Handshake: incomplete ({} of {} replies)'.format(len(replies), handshake_replies))
+        else:
+            frames = replies[handshake_replies - 1][0] - first_out_millis
+            print('Handshake: {:.0f} frames'.format(frames))
+
+    lines = [format_reply(report) + '\n' for _, report in replies]
+    print('Replies: {}'.format(len(lines)))
+
+    if args.update:
+        with open(golden, 'w') as f:
+            f.writelines(lines)
+        print('Wrote ' + golden)
+        return
+
+    if not os.path.exists(golden):
+        sys.exit('There\'s no {} to check against - make one with --update.'.format(golden))
+    with open(golden, 'r') as f:
+        expected = f.readlines()
+    if lines != expected:
+        sys.stdout.writelines(difflib.unified_diff(expected, lines, golden, 'replayed'))
+        sys.exit(1)
+    print('Matches ' + golden)
+
+
+if __name__ == '__main__':
+    main()
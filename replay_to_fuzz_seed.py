@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# Turns a recording of what the Switch sends (see lib/avr-host/include/
+# usbReplay.h) into a seed for the USB OUT fuzz target (see
+# lib/avr-host/src/fuzzUsbOut.cpp), so that fuzzing starts from traffic that
+# gets past the handshake.
+#
+# Usage:
+#   replay_to_fuzz_seed.py replays/switch_connect.replay replays/fuzz_corpus/switch_connect
+#
+# Reports are sent as short as they are in the recording (rather than padded
+# to 64 bytes) to keep the seed small. Waits between them are in frames, like
+# the recording's times - plus, after commands that get a reply, long enough
+# for it to be sent.
+
+import argparse
+import sys
+
+from replay_switch_traffic import expects_reply, read_recording
+
+# The fuzz target lets USB come up for this long before each input.
+start_millis = 500
+
+# Generous - replies usually take 10 or 20 frames.
+reply_frames = 40
+
+packet_size = 8
+
+
+def wait(frames):
+    ops = bytearray()
+    while frames > 0:
+        chunk = min(frames, 0x40)
+        ops.append(0xc0 | (chunk - 1))
+        frames -= chunk
+    return ops
+
+
+def send_report(data):
+    ops = bytearray()
+    if len(data) % packet_size == 0 and len(data) < 64:
+        # A report ends with a short packet - and a zero length one isn't
+        # possible here. The Switch pads with zeros anyway.
+        data = data + [0]
+    for i in range(0, len(data), packet_size):
+        packet = data[i:i + packet_size]
+        ops.append(len(packet) - 1)
+        ops += bytes(packet)
+    return ops
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('recording')
+    parser.add_argument('seed')
+    args = parser.parse_args()
+
+    seed = bytearray()
+    millis = start_millis
+    for transfer in read_recording(args.recording):
+        time, kind, data = transfer
+        if kind != 'OUT':
+            sys.exit('Only OUT transfers can be fuzzed.')
+        frames = int(time) if time.startswith('+') else int(time) - millis
+        seed += wait(frames)
+        seed += send_report(data)
+        millis += frames
+        if expects_reply(transfer):
+            seed += wait(reply_frames)
+            millis += reply_frames
+
+    with open(args.seed, 'wb') as f:
+        f.write(seed)
+    print('Wrote {} ({} bytes)'.format(args.seed, len(seed)))
+
+
+if __name__ == '__main__':
+    main()
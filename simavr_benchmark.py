@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Runs the firmware's benchmarks (see src/benchmark.h) in simavr, and prints
+# the cycle counts as JSON.
+#
+# Usage:
+#   pio run -e ATmega8Benchmark
+#   simavr_benchmark.py [--simavr path/to/simavr] [firmware.elf] > cycles.json
+#
+# Or, to read the results from a real chip's serial output instead:
+#   simavr_benchmark.py --log serial.log
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+project_dir = os.path.dirname(os.path.abspath(__file__))
+default_elf = os.path.join(project_dir, '.pio', 'build', 'ATmega8Benchmark', 'firmware.elf')
+
+f_cpu = 12800000
+
+# Matches BenchmarkId in src/benchmark.h.
+benchmarks = [
+    'prepareInputSubReportInBuffer (canned Dual Shock reply)',
+    'convertDualShockToSwitch',
+    'transmitPacket',
+    'decodeSwitchRumbleState (single wave)',
+    'decodeSwitchRumbleState (dual wave)',
+    'decodeSwitchRumbleState (dual resonance, 3 pulses)',
+    'decodeSwitchRumbleState (dual resonance, 4 pulses)',
+    'spiMemoryRead (flash)',
+    'spiMemoryRead (EEPROM)',
+    'serialPrintStr6',
+    'str6CharAtIndex (whole string)',
+    'str6ReadChar (whole string)',
+    'mixSwitchRumbleStates',
+]
+
+# (simavr prints the UART's output a line at a time, with colour codes around
+# it and the newline as a '.'.)
+result_line = re.compile(r'BENCH ([0-9A-F]{2}) ([0-9A-F]{4}) ([0-9A-F]{4})')
+
+
+def run_simavr(simavr, mcu, elf):
+    # simavr stops when the firmware sleeps with interrupts disabled, which
+    # it does once it's printed the results. The timeout is just in case.
+    completed = subprocess.run([simavr, '-m', mcu, '-f', str(f_cpu), elf],
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                               errors='replace', timeout=120)
+    return completed.stdout
+
+
+def parse_results(output):
+    results = []
+    for match in result_line.finditer(output):
+        index, fastest, slowest = (int(field, 16) for field in match.groups())
+        name = benchmarks[index] if index < len(benchmarks) else 'Benchmark 0x{:02X}'.format(index)
+        result = {'function': name}
+        if fastest == 0xffff:
+            # Timer 1 overflowed.
+            result['overflowed'] = True
+        else:
+            result['cycles'] = fastest
+            result['slowestCycles'] = slowest
+            result['microseconds'] = round(fastest * 1000000 / f_cpu, 2)
+        results.append(result)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('elf', nargs='?', default=default_elf)
+    parser.add_argument('--simavr', default='simavr')
+    parser.add_argument('--mcu', default='atmega8')
+    parser.add_argument('--log', help='read results from a captured serial log rather than running simavr')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, 'r', errors='replace') as f:
+            output = f.read()
+    else:
+        output = run_simavr(args.simavr, args.mcu, args.elf)
+
+    results = parse_results(output)
+    if not results:
+        sys.stderr.write(output)
+        sys.exit('No benchmark results found.')
+
+    json.dump({'mcu': args.mcu, 'fCpu': f_cpu, 'benchmarks': results}, sys.stdout, indent=2)
+    print()
+
+
+if __name__ == '__main__':
+    main()
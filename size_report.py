@@ -0,0 +1,407 @@
+#!/usr/bin/env python3
+# Breaks down where the firmware's flash and RAM go - by symbol, and by source
+# file - and works out how deep the stack can get, including interrupts.
+#
+# Usage:
+#   pio run -e ATmega8 -t size_report
+#   (Or run it directly, as size_report.py [options] firmware.elf - see
+#   --help.)
+#
+# The stack depth is worked out from the disassembly: each function's frame
+# (its pushes, and the space it makes for locals), plus the deepest chain of
+# calls it can make, plus two bytes for each return address. Interrupts are
+# added on top of the main program's worst case: every ISR_NOBLOCK interrupt
+# can land on top of the others, and any blocking one (i.e. V-USB's) on top
+# of all of them. It can't follow indirect calls, or tell when a call is in a
+# loop that never runs - those are listed, so they can be checked by hand.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+project_dir = os.path.dirname(os.path.abspath(__file__))
+
+# The ATmega8 and ATmega88P are the same here.
+default_flash_size = 7680
+default_ram_size = 1024
+
+
+def run_tool(prefix, tool, *args):
+    completed = subprocess.run([prefix + tool] + list(args), stdout=subprocess.PIPE,
+                               errors='replace', check=True)
+    return completed.stdout
+
+
+def read_sections(prefix, elf):
+    # e.g. '  [ 1] .text  PROGBITS  00000000 000094 001d2a 00  AX  0   0  2'
+    sections = {}
+    section_line = re.compile(r'^\s*\[\s*(\d+)\]\s+(\S+)\s+\S+\s+[0-9a-f]+\s+[0-9a-f]+\s+([0-9a-f]+)')
+    for line in run_tool(prefix, 'readelf', '-S', '-W', elf).splitlines():
+        match = section_line.match(line)
+        if match:
+            index, name, size = match.groups()
+            sections[int(index)] = (name, int(size, 16))
+    return sections
+
+
+def read_symbols(prefix, elf, sections):
+    # e.g. '    42: 00000a6e   188 FUNC    LOCAL  DEFAULT    1 _ZL9serialPollv'
+    symbols = []
+    symbol_line = re.compile(r'^\s*\d+:\s+([0-9a-f]+)\s+(\d+)\s+(\w+)\s+\w+\s+\w+\s+(\d+)\s+(\S+)$')
+    for line in run_tool(prefix, 'readelf', '-s', '-W', elf).splitlines():
+        match = symbol_line.match(line)
+        if not match:
+            continue
+        address, size, kind, section_index, name = match.groups()
+        size = int(size)
+        section_index = int(section_index)
+        if size == 0 or kind not in ('FUNC', 'OBJECT') or section_index not in sections:
+            continue
+        symbols.append({
+            'name': name,
+            'address': int(address, 16),
+            'size': size,
+            'kind': kind,
+            'section': sections[section_index][0],
+        })
+    return symbols
+
+
+def read_files(prefix, elf):
+    # Which source file each symbol's from, from the debug info. e.g.
+    # '00000a6e t _ZL9serialPollv	/path/to/src/serial.cpp:164'
+    files = {}
+    for line in run_tool(prefix, 'nm', '-l', '--defined-only', elf).splitlines():
+        fields = line.split('\t')
+        if len(fields) != 2:
+            continue
+        symbol = fields[0].split()
+        if len(symbol) != 3:
+            continue
+        path = fields[1].rsplit(':', 1)[0]
+        if os.path.isabs(path):
+            relative = os.path.relpath(path, project_dir)
+            if not relative.startswith('..'):
+                path = relative
+        files[(int(symbol[0], 16), symbol[2])] = path
+    return files
+
+
+def demangle(prefix, names):
+    if not names:
+        return {}
+    try:
+        completed = subprocess.run([prefix + 'c++filt'], input='\n'.join(names), stdout=subprocess.PIPE,
+                                   errors='replace', check=True)
+    except (OSError, subprocess.CalledProcessError):
+        return {name: name for name in names}
+    return dict(zip(names, completed.stdout.splitlines()))
+
+
+def classify(symbol):
+    # PROGMEM tables end up in .text, alongside the code.
+    section = symbol['section']
+    if section == '.text':
+        return 'code' if symbol['kind'] == 'FUNC' else 'progmem'
+    if section == '.data':
+        return 'data'
+    if section in ('.bss', '.noinit'):
+        return 'bss'
+    if section == '.eeprom':
+        return 'eeprom'
+    return None
+
+
+# Stack analysis.
+
+instruction_line = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{2} )+\s*(\S+)\s*([^;]*)')
+function_line = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+target = re.compile(r'<([^>+]+)(?:\+0x[0-9a-f]+)?>')
+
+
+def parse_disassembly(text):
+    functions = {}
+    current = None
+    for line in text.splitlines():
+        match = function_line.match(line)
+        if match:
+            current = {'instructions': []}
+            functions[match.group(1)] = current
+            continue
+        match = instruction_line.match(line)
+        if match and current is not None:
+            mnemonic, operands = match.groups()
+            called = target.search(line)
+            current['instructions'].append((mnemonic, operands.strip(), called.group(1) if called else None))
+    return functions
+
+
+def register_operands(operands):
+    return [operand.strip() for operand in operands.split(',')]
+
+
+def immediate(operand):
+    return int(operand, 0) & 0xff
+
+
+# The stack pointer's I/O addresses, as objdump shows them (or as the compiler
+# writes them, in a listing).
+stack_pointer_low = ('0x3d', '61', '__sp_l__')
+stack_pointer_high = ('0x3e', '62', '__sp_h__')
+
+# How far into a handler ISR_NOBLOCK's `sei` can be. The compiler puts it
+# first; the serial receive handler (which is naked) reads the UART before
+# re-enabling interrupts, so its `sei` is eighth.
+nonblocking_sei_window = 10
+
+
+def locals_size(instructions):
+    # Room for locals is made in the prologue, by copying the stack pointer
+    # to Y and subtracting from it: `in r28, 0x3d`, `in r29, 0x3e`, then
+    # either `sbiw r28, N` or `subi r28, lo8(N)`/`sbci r29, hi8(N)`. (Later
+    # arithmetic on Y is pointer arithmetic, or the epilogue.)
+    for index in range(len(instructions) - 2):
+        first, second = instructions[index], instructions[index + 1]
+        if first[0] != 'in' or second[0] != 'in':
+            continue
+        if register_operands(first[1])[:1] != ['r28'] or register_operands(second[1])[:1] != ['r29']:
+            continue
+        if register_operands(first[1])[1].lower() not in stack_pointer_low:
+            continue
+        if register_operands(second[1])[1].lower() not in stack_pointer_high:
+            continue
+        mnemonic, operands, _ = instructions[index + 2]
+        operands = register_operands(operands)
+        if mnemonic == 'sbiw' and operands[0] == 'r28':
+            return int(operands[1], 0)
+        if mnemonic == 'subi' and operands[0] == 'r28' and index + 3 < len(instructions):
+            high_mnemonic, high_operands, _ = instructions[index + 3]
+            high_operands = register_operands(high_operands)
+            high = immediate(high_operands[1]) if high_mnemonic == 'sbci' and high_operands[0] == 'r29' else 0
+            return immediate(operands[1]) | high << 8
+        return 0
+    return 0
+
+
+def analyse_function(name, instructions):
+    frame = locals_size(instructions)
+    calls = set()
+    indirect = False
+    for mnemonic, operands, called in instructions:
+        if mnemonic == 'push':
+            frame += 1
+        elif mnemonic == 'rcall' and operands == '.+0':
+            # (A quick way to make two bytes of room for locals.)
+            frame += 2
+        elif mnemonic in ('call', 'rcall', 'jmp', 'rjmp') and called and called != name:
+            # (Jumps to other functions are tail calls. Counting them as calls
+            # overestimates a little.)
+            calls.add(called)
+        elif mnemonic in ('icall', 'eicall', 'ijmp', 'eijmp'):
+            indirect = True
+
+    # ISR_NOBLOCK handlers re-enable interrupts straight away (or nearly).
+    nonblocking = False
+    for mnemonic, _, _ in instructions[:nonblocking_sei_window]:
+        if mnemonic == 'cli':
+            break
+        if mnemonic == 'sei':
+            nonblocking = True
+            break
+    return {
+        'frame': frame,
+        'calls': calls,
+        'indirect': indirect,
+        'nonblocking': nonblocking,
+    }
+
+
+def stack_depths(functions):
+    analysed = {name: analyse_function(name, function['instructions']) for name, function in functions.items()}
+    depths = {}
+    recursive = set()
+
+    def depth(name, visiting):
+        if name in depths:
+            return depths[name]
+        if name not in analysed:
+            return (0, [name])
+        if name in visiting:
+            recursive.add(name)
+            return (0, [name])
+        visiting.add(name)
+        deepest = (0, [])
+        for called in analysed[name]['calls']:
+            called_depth, chain = depth(called, visiting)
+            if called_depth + 2 > deepest[0]:
+                deepest = (called_depth + 2, chain)
+        visiting.discard(name)
+        result = (analysed[name]['frame'] + deepest[0], [name] + deepest[1])
+        depths[name] = result
+        return result
+
+    for name in analysed:
+        depth(name, set())
+    return analysed, depths, recursive
+
+
+def analyse_stack(prefix, elf, names):
+    functions = parse_disassembly(run_tool(prefix, 'objdump', '-d', elf))
+    analysed, depths, recursive = stack_depths(functions)
+
+    main = depths.get('main', (0, []))
+    interrupts = []
+    for name in sorted(analysed):
+        if re.match(r'^__vector_\d+$', name):
+            interrupt_depth, chain = depths[name]
+            # (The return address the interrupt pushes.)
+            interrupts.append({
+                'vector': name,
+                'bytes': interrupt_depth + 2,
+                'nonblocking': analysed[name]['nonblocking'],
+                'chain': [names.get(link, link) for link in chain],
+            })
+
+    nonblocking_total = sum(interrupt['bytes'] for interrupt in interrupts if interrupt['nonblocking'])
+    blocking_worst = max([interrupt['bytes'] for interrupt in interrupts if not interrupt['nonblocking']] or [0])
+
+    # Whatever's reachable from main or an interrupt, that calls indirectly.
+    reachable = set()
+    pending = ['main'] + [interrupt['vector'] for interrupt in interrupts]
+    while pending:
+        name = pending.pop()
+        if name in reachable or name not in analysed:
+            continue
+        reachable.add(name)
+        pending.extend(analysed[name]['calls'])
+
+    return {
+        'main': {'bytes': main[0], 'chain': [names.get(link, link) for link in main[1]]},
+        'interrupts': interrupts,
+        'worstCase': main[0] + nonblocking_total + blocking_worst,
+        'indirectCalls': sorted(names.get(name, name) for name in reachable if analysed[name]['indirect']),
+        'recursive': sorted(names.get(name, name) for name in recursive),
+    }
+
+
+def build_report(prefix, elf, flash_size, ram_size):
+    sections = read_sections(prefix, elf)
+    symbols = read_symbols(prefix, elf, sections)
+    files = read_files(prefix, elf)
+    names = demangle(prefix, sorted({symbol['name'] for symbol in symbols} | {'main'}))
+
+    by_symbol = []
+    by_file = {}
+    totals = {'code': 0, 'progmem': 0, 'data': 0, 'bss': 0, 'eeprom': 0}
+    for symbol in symbols:
+        kind = classify(symbol)
+        if kind is None:
+            continue
+        path = files.get((symbol['address'], symbol['name']), '?')
+        by_symbol.append({
+            'symbol': names.get(symbol['name'], symbol['name']),
+            'kind': kind,
+            'bytes': symbol['size'],
+            'file': path,
+        })
+        by_file.setdefault(path, dict.fromkeys(totals, 0))[kind] += symbol['size']
+        totals[kind] += symbol['size']
+    by_symbol.sort(key=lambda entry: (-entry['bytes'], entry['symbol']))
+
+    section_sizes = {name: size for name, size in sections.values()}
+    text = section_sizes.get('.text', 0)
+    data = section_sizes.get('.data', 0)
+    bss = section_sizes.get('.bss', 0) + section_sizes.get('.noinit', 0)
+
+    stack = analyse_stack(prefix, elf, names)
+    static_ram = data + bss
+    return {
+        'flash': {
+            'bytes': text + data,
+            'limit': flash_size,
+            'free': flash_size - (text + data),
+            'code': totals['code'],
+            'progmem': totals['progmem'],
+            'dataInitialisers': data,
+            # Vectors, start-up code, and anything without a size.
+            'other': text - totals['code'] - totals['progmem'],
+        },
+        'ram': {
+            'data': data,
+            'bss': bss,
+            'stackWorstCase': stack['worstCase'],
+            'limit': ram_size,
+            'free': ram_size - static_ram - stack['worstCase'],
+        },
+        'stack': stack,
+        'files': [dict(file=path, **sizes) for path, sizes in sorted(by_file.items())],
+        'symbols': by_symbol,
+    }
+
+
+def print_report(report, symbol_count):
+    flash = report['flash']
+    print('Flash: {} of {} bytes ({} free)'.format(flash['bytes'], flash['limit'], flash['free']))
+    print('  Code:                 {:5}'.format(flash['code']))
+    print('  PROGMEM:              {:5}'.format(flash['progmem']))
+    print('  .data initialisers:   {:5}'.format(flash['dataInitialisers']))
+    print('  Vectors, startup etc: {:5}'.format(flash['other']))
+
+    ram = report['ram']
+    print('RAM: {} of {} bytes ({} free)'.format(ram['limit'] - ram['free'], ram['limit'], ram['free']))
+    print('  .data:                {:5}'.format(ram['data']))
+    print('  .bss:                 {:5}'.format(ram['bss']))
+    print('  Stack (worst case):   {:5}'.format(ram['stackWorstCase']))
+
+    stack = report['stack']
+    print()
+    print('Stack:')
+    print('  main: {} bytes - {}'.format(stack['main']['bytes'], ' > '.join(stack['main']['chain'])))
+    for interrupt in stack['interrupts']:
+        print('  {} ({}): {} bytes - {}'.format(
+            interrupt['vector'], 'ISR_NOBLOCK' if interrupt['nonblocking'] else 'blocking',
+            interrupt['bytes'], ' > '.join(interrupt['chain'])))
+    if stack['indirectCalls']:
+        print('  Not counted - indirect calls from: ' + ', '.join(stack['indirectCalls']))
+    if stack['recursive']:
+        print('  Not counted - recursion through: ' + ', '.join(stack['recursive']))
+
+    print()
+    print('{:<40} {:>6} {:>8} {:>6} {:>6} {:>7}'.format('By file', 'code', 'progmem', 'data', 'bss', 'eeprom'))
+    for sizes in report['files']:
+        print('{:<40} {:>6} {:>8} {:>6} {:>6} {:>7}'.format(
+            sizes['file'], sizes['code'], sizes['progmem'], sizes['data'], sizes['bss'], sizes['eeprom']))
+
+    print()
+    print('{:<9} {:>6}  {:<30} {}'.format('By symbol', 'bytes', 'file', 'symbol'))
+    for entry in report['symbols'][:symbol_count]:
+        print('{:<9} {:>6}  {:<30} {}'.format(entry['kind'], entry['bytes'], entry['file'], entry['symbol']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('elf')
+    parser.add_argument('--tools-prefix', default='avr-', help='prefix for the binutils to use (default: avr-)')
+    parser.add_argument('--flash-size', type=int, default=default_flash_size)
+    parser.add_argument('--ram-size', type=int, default=default_ram_size)
+    parser.add_argument('--symbols', type=int, default=40, help='how many of the biggest symbols to list')
+    parser.add_argument('--json', action='store_true', help='print the whole report as JSON instead')
+    args = parser.parse_args()
+
+    try:
+        report = build_report(args.tools_prefix, args.elf, args.flash_size, args.ram_size)
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit('Couldn\'t read {}: {}'.format(args.elf, e))
+
+    if args.json:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+    else:
+        print_report(report, args.symbols)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,19 @@
+Import("env")
+
+# Adds a 'size_report' target - `pio run -e ATmega8 -t size_report` - that
+# breaks down the firmware's flash, RAM and stack use with `size_report.py`.
+
+# Debug info tells the report which source file each symbol came from. It
+# stays in the ELF - none of it ends up in flash.
+env.Append(CCFLAGS=["-g"], LINKFLAGS=["-g"])
+
+board = env.BoardConfig()
+env.AddCustomTarget(
+    name="size_report",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions='"$PYTHONEXE" "%s" --flash-size %s --ram-size %s $SOURCE' % (
+        env.subst("$PROJECT_DIR/size_report.py"),
+        board.get("upload.maximum_size", 7680),
+        board.get("upload.maximum_ram_size", 1024)),
+    title="Size report",
+    description="Flash, RAM and stack use, by symbol and source file")
@@ -0,0 +1,128 @@
+#include "ackTiming.h"
+
+#if ACK_TIMING_ON
+
+#include "serial.h"
+#include "packedStrings.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <string.h>
+
+// The analog poll - the transaction that matters - acknowledges 8 bytes.
+static const uint8_t sByteCount = 8;
+
+struct AckTimingStatistic {
+    uint16_t minimum;
+    uint16_t maximum;
+    uint32_t total;
+    uint16_t count;
+    uint8_t missed;     // Times we gave up waiting.
+};
+
+static AckTimingStatistic sStatistics[sByteCount];
+
+static uint8_t sByteIndex;
+static uint16_t sByteSentTime;
+static volatile uint16_t sAcknowledgedTime;
+static volatile bool sAcknowledged;
+
+static void reset()
+{
+    memset(sStatistics, 0, sizeof(sStatistics));
+    for(uint8_t i = 0; i < sByteCount; ++i) {
+        sStatistics[i].minimum = 0xffff;
+    }
+}
+
+void ackTimingInit()
+{
+    // Normal mode, F_CPU / 8.
+    TCCR1A = 0;
+    TCCR1B = 1 << CS11;
+
+    reset();
+}
+
+void ackTimingByteSent(const uint8_t byteIndex)
+{
+    // (The ACK can arrive before we get here, so `sAcknowledged` is cleared
+    // after each wait instead.)
+    // Reading TCNT1 goes through the shared TEMP register, so an ACK
+    // interrupt between the two byte reads - it reads TCNT1 too - would give
+    // us its high byte. A few cycles with interrupts off, well inside what
+    // V-USB can stand.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sByteSentTime = TCNT1;
+    }
+    sByteIndex = byteIndex;
+}
+
+void ackTimingAcknowledged()
+{
+    sAcknowledgedTime = TCNT1;
+    sAcknowledged = true;
+}
+
+void ackTimingWaitFinished()
+{
+    const bool acknowledged = sAcknowledged;
+    sAcknowledged = false;
+
+    if(sByteIndex >= sByteCount) {
+        return;
+    }
+    AckTimingStatistic *statistic = &sStatistics[sByteIndex];
+
+    if(!acknowledged) {
+        if(statistic->missed != 0xff) {
+            ++statistic->missed;
+        }
+        return;
+    }
+
+    // Stop counting before anything overflows.
+    if(statistic->count == 0xffff) {
+        return;
+    }
+
+    uint16_t ticks = sAcknowledgedTime - sByteSentTime;
+    if(ticks >= 0x8000) {
+        // The ACK arrived before we noted the byte finishing.
+        ticks = 0;
+    }
+    if(ticks < statistic->minimum) {
+        statistic->minimum = ticks;
+    }
+    if(ticks > statistic->maximum) {
+        statistic->maximum = ticks;
+    }
+    statistic->total += ticks;
+    ++statistic->count;
+}
+
+void ackTimingDump()
+{
+    // All in hex. Times are in timer 1 ticks (F_CPU / 8).
+    // Each line is: byte, minimum, mean, maximum, count, missed.
+    serialPrintStr6(STR6("\nACK\n"), true);
+    for(uint8_t i = 0; i < sByteCount; ++i) {
+        const AckTimingStatistic *statistic = &sStatistics[i];
+        serialPrintHex(i, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->minimum, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->count ? statistic->total / statistic->count : 0, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->maximum, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->count, true);
+        serialPrint(' ', true);
+        serialPrintHex(statistic->missed, true);
+        serialPrint('\n', true);
+    }
+
+    reset();
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __acktiming_h_included__
+#define __acktiming_h_included__
+
+#include <stdint.h>
+
+// Diagnostics for how quickly the attached DualShock acknowledges each byte
+// of a transaction - which is what limits how fast we can talk to it.
+//
+// Timer 1 runs free at F_CPU / 8 (0.625us at 12.8MHz). We note its count
+// when the SPI hardware finishes each byte, and the ACK interrupt notes it
+// when the ACK arrives. The differences are accumulated per byte position.
+// (The ACK line is on INT1 rather than Timer 1's input capture pin - which is
+// the debug LED - so the ACK time includes the interrupt's latency, and any
+// time spent in V-USB's interrupt first. Expect occasional high maximums.)
+//
+// Off by default - it costs around 100 bytes of RAM.
+
+#ifndef ACK_TIMING_ON
+#define ACK_TIMING_ON 0
+#endif
+
+#if ACK_TIMING_ON
+void ackTimingInit();
+
+// Call when the SPI hardware has finished sending byte `byteIndex`.
+void ackTimingByteSent(const uint8_t byteIndex);
+
+// Call from the ACK interrupt handler.
+void ackTimingAcknowledged();
+
+// Call once done waiting for the ACK for the byte passed to
+// `ackTimingByteSent()` - whether it arrived or not.
+void ackTimingWaitFinished();
+
+// Prints the statistics over serial (waiting for space in the buffer), then
+// starts again from scratch.
+void ackTimingDump();
+#else
+static inline void ackTimingInit() {}
+static inline void ackTimingByteSent(const uint8_t byteIndex) {}
+static inline void ackTimingAcknowledged() {}
+static inline void ackTimingWaitFinished() {}
+static inline void ackTimingDump() {}
+#endif
+
+#endif // __acktiming_h_included__
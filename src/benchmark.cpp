@@ -0,0 +1,131 @@
+#include "benchmark.h"
+
+#if BENCHMARK_ON
+
+#include "serial.h"
+#include "packedStrings.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/delay.h>
+
+#ifdef AVR_HOST
+#error "The host build doesn't count cycles - benchmark the ATmega8Benchmark build in simavr instead"
+#endif
+
+static uint16_t sFastestCycles[BENCHMARK_COUNT];
+static uint16_t sSlowestCycles[BENCHMARK_COUNT];
+
+// The cycles counted when timing nothing at all - i.e. the cost of
+// `benchmarkStart()` and `benchmarkStop()` themselves.
+static uint16_t sOverheadCycles = 0;
+
+// The interrupt enable bits masked while timing, to put back afterwards.
+static uint8_t sSavedUartInterrupts;
+static uint8_t sSavedTimerInterrupts;
+
+void benchmarkInit()
+{
+    // Normal mode, counting every cycle. At 12.8MHz it overflows after about
+    // 5ms, which is plenty.
+    TCCR1A = 0;
+    TCCR1B = 1 << CS10;
+
+    for(uint8_t i = 0; i < BENCHMARK_COUNT; ++i) {
+        sFastestCycles[i] = 0xffff;
+        sSlowestCycles[i] = 0;
+    }
+
+    // (`BENCHMARK_COUNT` is used to mean "just measure the overhead".)
+    benchmarkStart();
+    benchmarkStop(BENCHMARK_COUNT);
+}
+
+void benchmarkStart()
+{
+    // Nothing else may run while we're timing. The UART's transmit complete
+    // interrupt and Timer 0's overflow interrupt are the only ones enabled
+    // (the adapter isn't started, so USB is quiet), and their flags stay set
+    // until they're unmasked - so a timed statement that prints just fills
+    // the buffer, and the character goes once we've stopped. A run longer
+    // than Timer 0's 1.28ms period would lose overflows, but nothing here
+    // keeps time.
+#if __AVR_ATmega8__
+    sSavedUartInterrupts = UCSRB & ((1 << TXCIE) | (1 << UDRIE));
+    UCSRB &= ~((1 << TXCIE) | (1 << UDRIE));
+    sSavedTimerInterrupts = TIMSK & (1 << TOIE0);
+    TIMSK &= ~(1 << TOIE0);
+    TIFR = 1 << TOV1;
+#else
+    sSavedUartInterrupts = UCSR0B & ((1 << TXCIE0) | (1 << UDRIE0));
+    UCSR0B &= ~((1 << TXCIE0) | (1 << UDRIE0));
+    sSavedTimerInterrupts = TIMSK0 & (1 << TOIE0);
+    TIMSK0 &= ~(1 << TOIE0);
+    TIFR1 = 1 << TOV1;
+#endif
+    TCNT1 = 0;
+}
+
+void benchmarkStop(const BenchmarkId id)
+{
+    uint16_t cycles = TCNT1;
+
+#if __AVR_ATmega8__
+    UCSRB |= sSavedUartInterrupts;
+    TIMSK |= sSavedTimerInterrupts;
+#else
+    UCSR0B |= sSavedUartInterrupts;
+    TIMSK0 |= sSavedTimerInterrupts;
+#endif
+
+    if(id == BENCHMARK_COUNT) {
+        sOverheadCycles = cycles;
+        return;
+    }
+
+#if __AVR_ATmega8__
+    if(TIFR & (1 << TOV1)) {
+#else
+    if(TIFR1 & (1 << TOV1)) {
+#endif
+        // Too slow to count.
+        cycles = 0xffff;
+    } else {
+        cycles -= sOverheadCycles;
+    }
+
+    if(cycles < sFastestCycles[id]) {
+        sFastestCycles[id] = cycles;
+    }
+    if(cycles > sSlowestCycles[id]) {
+        sSlowestCycles[id] = cycles;
+    }
+}
+
+void benchmarkFinish()
+{
+    // All in hex. Each line is: benchmark, fastest, slowest.
+    serialPrintStr6(STR6("\nBENCH START\n"), true);
+    for(uint8_t i = 0; i < BENCHMARK_COUNT; ++i) {
+        serialPrintStr6(STR6("BENCH "), true);
+        serialPrintHex(i, true);
+        serialPrint(' ', true);
+        serialPrintHex16(sFastestCycles[i], true);
+        serialPrint(' ', true);
+        serialPrintHex16(sSlowestCycles[i], true);
+        serialPrint('\n', true);
+    }
+    serialPrintStr6(STR6("BENCH END\n"), true);
+
+    // Let the last character go before stopping for good. Sleeping with
+    // interrupts disabled is also how simavr knows we're finished.
+    serialPrint('\n', true);
+    _delay_ms(1);
+    cli();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sleep_cpu();
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __benchmark_h_included__
+#define __benchmark_h_included__
+
+#include <stdint.h>
+
+// Exact cycle counts for the busiest functions.
+//
+// With BENCHMARK_ON, the firmware doesn't start the adapter. Instead it runs
+// each benchmark in `runBenchmarks()` (in main.cpp) a number of times, timed by
+// Timer 1 counting every CPU cycle, then prints the fastest and slowest time
+// for each and halts. `simavr_benchmark.py`, in the project directory, runs
+// the 'ATmega8Benchmark' build in simavr and turns the results into JSON. It
+// works on a real chip too - just read the serial output.
+//
+// Interrupts are masked while timing (see `benchmarkStart()`), so the fastest
+// and slowest times should only differ where the input does.
+
+#ifndef BENCHMARK_ON
+#define BENCHMARK_ON 0
+#endif
+
+#if BENCHMARK_ON
+
+#include "ackTiming.h"
+static_assert(!ACK_TIMING_ON, "Benchmarks and ACK timing both need Timer 1");
+
+// Only add to the end of this list, to match `simavr_benchmark.py`.
+enum BenchmarkId {
+    BENCHMARK_PREPARE_INPUT_SUB_REPORT_IN_BUFFER,
+    BENCHMARK_CONVERT_DUAL_SHOCK_TO_SWITCH,
+    BENCHMARK_TRANSMIT_PACKET,
+    BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_SINGLE_WAVE,
+    BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_WAVE,
+    BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_RESONANCE_3,
+    BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_RESONANCE_4,
+    BENCHMARK_SPI_MEMORY_READ_FLASH,
+    BENCHMARK_SPI_MEMORY_READ_EEPROM,
+    BENCHMARK_SERIAL_PRINT_STR6,
+    BENCHMARK_STR6_CHAR_AT_INDEX,
+    BENCHMARK_STR6_READ_CHAR,
+    BENCHMARK_MIX_SWITCH_RUMBLE_STATES,
+    BENCHMARK_COUNT
+};
+
+static const uint8_t sBenchmarkRuns = 16;
+
+void benchmarkInit();
+
+// Call these either side of the code to time.
+void benchmarkStart();
+void benchmarkStop(const BenchmarkId id);
+
+// Prints the results over serial, then halts. In simavr, that ends the
+// simulation.
+void benchmarkFinish();
+
+// Times `statement`, run `sBenchmarkRuns` times. It can use `run`, the run
+// number, to vary its input. Serial output from the previous run has all
+// been sent, and the UART is idle, before each one starts. `statement` mustn't
+// wait for serial output - nothing sends it until the run's over.
+#define BENCHMARK(id, statement) \
+    for(uint8_t run = 0; run < sBenchmarkRuns; ++run) { \
+        serialPrint(' ', true); \
+        serialFlush(); \
+        benchmarkStart(); \
+        statement; \
+        benchmarkStop(id); \
+    }
+
+#endif
+
+#endif // __benchmark_h_included__
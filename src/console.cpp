@@ -0,0 +1,112 @@
+#include "console.h"
+
+#if SERIAL_CONSOLE_ON
+
+#include "tuning.h"
+#include "trace.h"
+#include "latencyStats.h"
+#include "ackTiming.h"
+#include "flightRecorder.h"
+#include "packedStrings.h"
+
+static const uint8_t sLineLength = 12;
+static uint8_t sLine[sLineLength];
+static uint8_t sLineCursor = 0;
+
+// Parses up to two hex arguments after the command letter. Returns how many
+// were found.
+static uint8_t parseArguments(uint8_t *arguments)
+{
+    uint8_t count = 0;
+    bool inArgument = false;
+    for(uint8_t i = 1; i < sLineCursor; ++i) {
+        uint8_t ch = sLine[i];
+        uint8_t nybble;
+        if(ch >= '0' && ch <= '9') {
+            nybble = ch - '0';
+        } else if((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f') {
+            nybble = (ch | 0x20) - 'a' + 0xa;
+        } else {
+            inArgument = false;
+            continue;
+        }
+
+        if(!inArgument) {
+            if(count == 2) {
+                break;
+            }
+            inArgument = true;
+            arguments[count++] = 0;
+        }
+        arguments[count - 1] = arguments[count - 1] << 4 | nybble;
+    }
+    return count;
+}
+
+static void execute()
+{
+    uint8_t arguments[2];
+    const uint8_t argumentCount = parseArguments(arguments);
+
+    switch(sLine[0]) {
+    case 'g':
+        if(argumentCount == 1 && arguments[0] < TUNING_PARAMETER_COUNT) {
+            serialPrintHex(arguments[0]);
+            serialPrint('=');
+            serialPrintHex(tuningGet(arguments[0]));
+            serialPrint('\n');
+            return;
+        }
+        break;
+    case 's':
+        if(argumentCount == 2 && arguments[0] < TUNING_PARAMETER_COUNT) {
+            tuningSet(arguments[0], arguments[1]);
+            serialPrintStr6(STR6("OK\n"));
+            return;
+        }
+        break;
+    case 'w':
+        tuningSave();
+        serialPrintStr6(STR6("OK\n"));
+        return;
+    case 't':
+        traceDump();
+        return;
+    case 'c':
+        serialPrintStr6(STR6("SO "), true);
+        serialPrintHex(serialOverflowCount(), true);
+        serialPrint('\n', true);
+        latencyStatsDump();
+        ackTimingDump();
+        return;
+    case 'f':
+        if(flightRecorderPrint()) {
+            return;
+        }
+        break;
+    case 'e':
+        if(flightRecorderClear()) {
+            serialPrintStr6(STR6("OK\n"));
+            return;
+        }
+        break;
+    }
+    serialPrintStr6(STR6("?\n"));
+}
+
+void consolePoll()
+{
+    uint8_t ch;
+    while(serialRead(&ch)) {
+        if(ch == '\n' || ch == '\r') {
+            if(sLineCursor) {
+                execute();
+            }
+            sLineCursor = 0;
+        } else if(sLineCursor < sLineLength) {
+            sLine[sLineCursor++] = ch;
+        }
+    }
+}
+
+#endif
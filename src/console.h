@@ -0,0 +1,26 @@
+#ifndef __console_h_included__
+#define __console_h_included__
+
+#include "serial.h"
+
+// A tiny command interpreter on the serial port, for live tuning and
+// diagnostics. Enabled by SERIAL_CONSOLE_ON (see serial.h).
+//
+// Commands are a letter and hex arguments, ending with a newline:
+//     g P     Print the value of tuning parameter P (see tuning.h).
+//     s P V   Set tuning parameter P to V.
+//     w       Save the tuning parameters to EEPROM.
+//     t       Dump the event trace (see trace.h).
+//     c       Dump counters and statistics (serial overflows, latency
+//             statistics, ACK timing).
+//     f       Print the flight record, if there is one (see flightRecorder.h).
+//     e       Erase the flight record.
+
+#if SERIAL_CONSOLE_ON
+// Call regularly from the main loop.
+void consolePoll();
+#else
+static inline void consolePoll() {}
+#endif
+
+#endif // __console_h_included__
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
+// This is sent to the Switch as is, so it must be exactly 11 bytes. On the
+// AVR, bitfields pack into bytes anyway - `packed` makes the host build (see
+// lib/avr-host) lay it out the same way, rather than giving each group of
+// `int` bitfields an `int` of its own.
 typedef struct SwitchReport {
     int connectionInfo:4;
     int batteryLevel:4;
@@ -18,7 +22,7 @@ typedef struct SwitchReport {
             int shoulderRightLeftButton : 1;
             int rShoulderButton : 1;
             int zRShoulderButton : 1;
-        };
+        } __attribute__((packed));
     };
 
     union {
@@ -32,7 +36,7 @@ typedef struct SwitchReport {
             int captureButton : 1;
             int unusedButton : 1;
             int chargingGrip : 1;
-        };
+        } __attribute__((packed));
     };
 
     union {
@@ -46,13 +50,13 @@ typedef struct SwitchReport {
             int shoulderLeftLeftButton : 1;
             int lShoulderButton : 1;
             int zLShoulderButton : 1;
-        };
+        } __attribute__((packed));
     };
 
     uint8_t leftStick[3];
     uint8_t rightStick[3];
     uint8_t vibrationReport;
-} SwitchReport;
+} __attribute__((packed)) SwitchReport;
 
 typedef struct DualShockReport {
     uint8_t effEff;
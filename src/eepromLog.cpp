@@ -0,0 +1,261 @@
+#include "eepromLog.h"
+#include "eepromQueue.h"
+#include "flightRecorder.h"
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
+#include <stddef.h>
+
+static const uint8_t sChunkLength = 8;
+static const uint8_t sChunkCount = EEPROM_LOG_SIZE / sChunkLength;
+
+struct EepromLogRecord {
+    uint8_t sequence;   // Increments by one with every record appended.
+    uint8_t chunk;
+    uint8_t data[sChunkLength];
+    uint8_t crc;        // CRC-8 of everything above.
+};
+
+// The log fills the EEPROM, up to the flight recorder's region (which is
+// followed by the word where `prepareEEPROM()` keeps its magic number).
+static const uint8_t sSlotCount = FLIGHT_RECORDER_EEPROM_ADDRESS / sizeof(EepromLogRecord);
+static_assert(sSlotCount > sChunkCount, "EEPROM log is too small to hold every chunk");
+
+static const uint8_t sNoSlot = 0xff;
+
+// The slot holding the latest record for each chunk.
+static uint8_t sLatestSlots[sChunkCount];
+
+// What the store holds - including changes that are yet to be appended to the
+// log, which are flagged in `sChangedChunks`.
+static uint8_t sContents[EEPROM_LOG_SIZE];
+static uint16_t sChangedChunks = 0;
+static_assert(sChunkCount <= 16, "sChangedChunks has a bit per chunk");
+
+// Where, and with what sequence number, the next record will be written.
+static uint8_t sHeadSlot = 0;
+static uint8_t sNextSequence = 0;
+
+// After a format, slots that might still hold something that isn't ours, and
+// so still need to be erased. A slot is clean once we've either erased it or
+// written a record to it. `sEraseSlot` is where `eepromLogPoll()` looks next.
+static uint8_t sDirtySlots[(sSlotCount + 7) / 8];
+static uint8_t sEraseSlot = sSlotCount;
+
+static bool slotIsDirty(const uint8_t slot)
+{
+    return sDirtySlots[slot / 8] & (1 << (slot % 8));
+}
+
+static void markSlotClean(const uint8_t slot)
+{
+    sDirtySlots[slot / 8] &= ~(1 << (slot % 8));
+}
+
+static uint16_t slotAddress(const uint8_t slot)
+{
+    return (uint16_t)slot * sizeof(EepromLogRecord);
+}
+
+static uint8_t recordCrc(const EepromLogRecord *record)
+{
+    uint8_t crc = 0;
+    const uint8_t *bytes = (const uint8_t *)record;
+    for(uint8_t i = 0; i < offsetof(EepromLogRecord, crc); ++i) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+// Returns the chunk whose latest record is in `slot`, or sNoSlot if the slot
+// is free (erased, or holding an out-of-date record).
+static uint8_t liveChunkInSlot(const uint8_t slot)
+{
+    for(uint8_t chunk = 0; chunk < sChunkCount; ++chunk) {
+        if(sLatestSlots[chunk] == slot) {
+            return chunk;
+        }
+    }
+    return sNoSlot;
+}
+
+static uint8_t slotAfter(const uint8_t slot)
+{
+    return (uint8_t)(slot + 1) % sSlotCount;
+}
+
+static uint16_t chunkBit(const uint8_t chunk)
+{
+    return (uint16_t)1 << chunk;
+}
+
+// Appends a record of the chunk's current contents, and marks it as saved.
+// The write queue must have room for it.
+static void writeRecordAtHead(const uint8_t chunk)
+{
+    EepromLogRecord record;
+    record.sequence = sNextSequence;
+    record.chunk = chunk;
+    memcpy(record.data, &sContents[chunk * sChunkLength], sChunkLength);
+    record.crc = recordCrc(&record);
+
+    // The CRC is written last, so a record is only valid once it's complete.
+    eepromQueueWriteBlock(&record, slotAddress(sHeadSlot), sizeof(record));
+    markSlotClean(sHeadSlot);
+
+    sLatestSlots[chunk] = sHeadSlot;
+    sChangedChunks &= ~chunkBit(chunk);
+    ++sNextSequence;
+    sHeadSlot = slotAfter(sHeadSlot);
+}
+
+// Appends the next record needed to save the changed chunks, if the write
+// queue has room for it. Returns false if it didn't.
+static bool appendNextRecord()
+{
+    if(eepromQueueSpace() < sizeof(EepromLogRecord)) {
+        return false;
+    }
+
+    // The head slot is always free. Before we write to it, make sure the one
+    // after it - which will be the new head - is free too. If it holds the
+    // latest record for some chunk, we copy that into the head first, which
+    // frees its old slot. (If that chunk has changed, the copy saves the
+    // change too.)
+    // This keeps every live record within one trip around the log of the
+    // head, so it's also what keeps the sequence numbers comparable.
+    // There are always more slots than chunks, so we get to write a changed
+    // chunk eventually.
+    const uint8_t liveChunk = liveChunkInSlot(slotAfter(sHeadSlot));
+    if(liveChunk != sNoSlot) {
+        writeRecordAtHead(liveChunk);
+        return true;
+    }
+
+    uint8_t chunk = 0;
+    while(!(sChangedChunks & chunkBit(chunk))) {
+        ++chunk;
+    }
+    writeRecordAtHead(chunk);
+    return true;
+}
+
+void eepromLogInit()
+{
+    memset(sLatestSlots, sNoSlot, sizeof(sLatestSlots));
+
+    uint8_t latestSequences[sChunkCount];
+    bool foundNewest = false;
+    uint8_t newestSequence = 0;
+    uint8_t newestSlot = 0;
+
+    for(uint8_t slot = 0; slot < sSlotCount; ++slot) {
+        EepromLogRecord record;
+        eeprom_read_block(&record, (const void *)(intptr_t)slotAddress(slot), sizeof(record));
+        if(record.chunk >= sChunkCount || record.crc != recordCrc(&record)) {
+            // Erased, or a write was interrupted.
+            continue;
+        }
+
+        // Sequence numbers wrap, but all the valid ones are within
+        // sSlotCount of each other, so signed differences order them.
+        if(!foundNewest || (int8_t)(record.sequence - newestSequence) > 0) {
+            foundNewest = true;
+            newestSequence = record.sequence;
+            newestSlot = slot;
+        }
+        if(sLatestSlots[record.chunk] == sNoSlot || (int8_t)(record.sequence - latestSequences[record.chunk]) > 0) {
+            sLatestSlots[record.chunk] = slot;
+            latestSequences[record.chunk] = record.sequence;
+        }
+    }
+
+    if(foundNewest) {
+        sHeadSlot = (uint8_t)(newestSlot + 1) % sSlotCount;
+        sNextSequence = newestSequence + 1;
+    }
+
+    for(uint8_t chunk = 0; chunk < sChunkCount; ++chunk) {
+        uint8_t *data = &sContents[chunk * sChunkLength];
+        if(sLatestSlots[chunk] == sNoSlot) {
+            memset(data, 0xff, sChunkLength);
+        } else {
+            eeprom_read_block(data, (const void *)(intptr_t)(slotAddress(sLatestSlots[chunk]) + offsetof(EepromLogRecord, data)), sChunkLength);
+        }
+    }
+    sChangedChunks = 0;
+}
+
+void eepromLogFormat()
+{
+    memset(sLatestSlots, sNoSlot, sizeof(sLatestSlots));
+    sHeadSlot = 0;
+    sNextSequence = 0;
+    memset(sContents, 0xff, sizeof(sContents));
+    sChangedChunks = 0;
+
+    memset(sDirtySlots, 0xff, sizeof(sDirtySlots));
+    sEraseSlot = 0;
+}
+
+bool eepromLogPoll()
+{
+    if(sChangedChunks) {
+        appendNextRecord();
+    }
+
+    while(sEraseSlot < sSlotCount && !slotIsDirty(sEraseSlot)) {
+        ++sEraseSlot;
+    }
+    if(sEraseSlot == sSlotCount) {
+        return true;
+    }
+
+    // Only top up the queue when it's drained, so erasing never holds up
+    // saving what the Switch asked us to.
+    if(eepromQueueIsEmpty()) {
+        uint8_t erased[sizeof(EepromLogRecord)];
+        memset(erased, 0xff, sizeof(erased));
+        eepromQueueWriteBlock(erased, slotAddress(sEraseSlot), sizeof(erased));
+        markSlotClean(sEraseSlot);
+    }
+    return false;
+}
+
+void eepromLogFlush()
+{
+    while(sChangedChunks) {
+        if(!appendNextRecord()) {
+            eepromQueueFlush();
+        }
+    }
+    eepromQueueFlush();
+}
+
+void eepromLogReadBlock(void *out, uint8_t address, uint8_t length)
+{
+    memcpy(out, &sContents[address], length);
+}
+
+void eepromLogWriteBlock(const void *buffer, uint8_t address, uint8_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)buffer;
+    while(length) {
+        const uint8_t chunk = address / sChunkLength;
+        uint8_t chunkLength = sChunkLength - address % sChunkLength;
+        if(chunkLength > length) {
+            chunkLength = length;
+        }
+
+        // Don't use up a record if nothing's actually changed.
+        if(memcmp(&sContents[address], bytes, chunkLength) != 0) {
+            memcpy(&sContents[address], bytes, chunkLength);
+            sChangedChunks |= chunkBit(chunk);
+        }
+
+        bytes += chunkLength;
+        address += chunkLength;
+        length -= chunkLength;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef __eepromlog_h_included__
+#define __eepromlog_h_included__
+
+#include <stdint.h>
+
+// A small log-structured, wear-leveled store for the things we persist in
+// EEPROM (the Switch's user calibration, and our own settings).
+//
+// Rather than overwriting the same EEPROM cells every time something changes,
+// each change appends a CRC-protected record, holding an 8 byte 'chunk', to a
+// circular log that covers most of the EEPROM. Any chunks still live in the
+// part of the log that's about to be reused are copied forward first.
+// An index in RAM, built at startup, finds the latest record for each chunk
+// without searching the log.
+//
+// To users, the store looks like a small EEPROM of its own - read and write
+// bytes at addresses in the ranges below. Unwritten bytes read as 0xff.
+// A copy of it is kept in RAM, so reads never wait for the EEPROM, and writes
+// only change the copy. `eepromLogPoll()` then saves each changed chunk in the
+// background, a record at a time, whenever the write-behind queue (see
+// eepromQueue.h) has room for one - so a big write can't hold anything up.
+
+#define EEPROM_LOG_USER_CALIBRATION_ADDRESS 0x00    // 0x3c bytes.
+#define EEPROM_LOG_SETTINGS_ADDRESS 0x40            // 0x40 bytes.
+#define EEPROM_LOG_SIZE 0x80
+
+// One of these must be called at startup, before any other function here.
+// `eepromLogInit()` assumes the EEPROM is either erased or has been written
+// to by us, and finds the latest records in it.
+// `eepromLogFormat()` is for when it might hold anything else. It starts with
+// an empty log straight away, without blocking, and leaves `eepromLogPoll()`
+// to erase the old contents in the background.
+void eepromLogInit();
+void eepromLogFormat();
+
+// Queues the next record needed to save the changes, if the write queue has
+// room for it - then, if the queue is idle, the erase of the next slot left
+// over from before a format. Returns true once nothing is left to erase.
+bool eepromLogPoll();
+
+// Saves all the changes, and waits until they're written. For when the power
+// might go.
+void eepromLogFlush();
+
+void eepromLogReadBlock(void *out, uint8_t address, uint8_t length);
+void eepromLogWriteBlock(const void *buffer, uint8_t address, uint8_t length);
+
+#endif // __eepromlog_h_included__
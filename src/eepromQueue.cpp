@@ -0,0 +1,214 @@
+#include "eepromQueue.h"
+#include "trace.h"
+
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+// Room for one of the log's 11-byte records (see eepromLog.h), plus our own
+// magic number and the flight recorder's marker. The log only queues a record
+// when there's room for it, however much the Switch writes at once.
+static const uint8_t sQueueCapacity = 16;
+static_assert((sQueueCapacity & (sQueueCapacity - 1)) == 0, "sQueueCapacity must be a power of two");
+
+static uint16_t sQueueAddresses[sQueueCapacity];
+static uint8_t sQueueValues[sQueueCapacity];
+static uint8_t sQueueStart = 0;
+static volatile uint8_t sQueueLength = 0;
+
+// The main loop and the EEPROM ready interrupt (below) share the queue.
+// Searching it takes far longer than V-USB can wait for its interrupt, so
+// rather than disabling interrupts, the main loop masks just that one while
+// it's using the queue. (Setting and clearing the enable bit are single
+// instructions, so can't be interrupted - and the handler can't be running
+// when the main loop is.)
+static void lockQueue()
+{
+    EECR &= ~(1 << EERIE);
+    __asm__ volatile("" ::: "memory");
+}
+
+static void unlockQueue()
+{
+    __asm__ volatile("" ::: "memory");
+    if(sQueueLength) {
+        EECR |= 1 << EERIE;
+    }
+}
+
+static uint8_t queueIndex(const uint8_t position)
+{
+    return (uint8_t)(sQueueStart + position) & (sQueueCapacity - 1);
+}
+
+// Returns the queue index of the pending write to `address`, or sQueueCapacity
+// if there isn't one. There's only ever one, because we coalesce writes to
+// the same address.
+static uint8_t queueIndexForAddress(const uint16_t address)
+{
+    for(uint8_t position = 0; position < sQueueLength; ++position) {
+        const uint8_t index = queueIndex(position);
+        if(sQueueAddresses[index] == address) {
+            return index;
+        }
+    }
+    return sQueueCapacity;
+}
+
+// Commits the oldest queued byte. The EEPROM must be ready.
+static void commitOldest()
+{
+    uint8_t *address = (uint8_t *)(intptr_t)sQueueAddresses[sQueueStart];
+    const uint8_t value = sQueueValues[sQueueStart];
+    sQueueStart = queueIndex(1);
+    --sQueueLength;
+
+    // Like eeprom_update_byte(), save a write (and wear) if nothing's changed.
+    // Because the EEPROM is ready, neither of these will wait.
+    if(eeprom_read_byte(address) != value) {
+        eeprom_write_byte(address, value);
+        traceEvent(TRACE_EEPROM_WRITE, (uint8_t)(intptr_t)address);
+    }
+}
+
+// Called from the EEPROM ready interrupt, with interrupts enabled and the
+// interrupt masked.
+extern "C" void eepromQueueReady()
+{
+    commitOldest();
+    if(sQueueLength) {
+        EECR |= 1 << EERIE;
+    }
+}
+
+// The EEPROM ready interrupt fires for as long as the EEPROM is ready and it's
+// enabled, so an ISR_NOBLOCK handler would interrupt itself as soon as it
+// re-enabled interrupts. Instead, this masks it, re-enables interrupts, and
+// only then saves what a C function can change and calls eepromQueueReady().
+// Worst case, from the interrupt firing to the end of the instruction after
+// `sei`: 4 cycles to respond, 2 or 3 for the vector's jump, then 2+1+1 - 11
+// in all, well inside V-USB's 25 cycle limit.
+#ifdef AVR_HOST
+ISR(EE_RDY_vect, ISR_NOBLOCK)
+{
+    EECR &= ~(1 << EERIE);
+    eepromQueueReady();
+}
+#else
+#ifdef __AVR_ATmega8__
+ISR(EE_RDY_vect, ISR_NAKED)
+#else
+ISR(EE_READY_vect, ISR_NAKED)
+#endif
+{
+    asm volatile(
+        "cbi %[eecr], %[eerie]\n\t"
+        "sei\n\t"
+
+        "push r0\n\t"
+        "in r0, __SREG__\n\t"
+        "push r0\n\t"
+        "push r1\n\t"
+        "clr r1\n\t"
+        "push r18\n\t"
+        "push r19\n\t"
+        "push r20\n\t"
+        "push r21\n\t"
+        "push r22\n\t"
+        "push r23\n\t"
+        "push r24\n\t"
+        "push r25\n\t"
+        "push r26\n\t"
+        "push r27\n\t"
+        "push r30\n\t"
+        "push r31\n\t"
+
+        "rcall eepromQueueReady\n\t"
+
+        "pop r31\n\t"
+        "pop r30\n\t"
+        "pop r27\n\t"
+        "pop r26\n\t"
+        "pop r25\n\t"
+        "pop r24\n\t"
+        "pop r23\n\t"
+        "pop r22\n\t"
+        "pop r21\n\t"
+        "pop r20\n\t"
+        "pop r19\n\t"
+        "pop r18\n\t"
+        "pop r1\n\t"
+        "pop r0\n\t"
+        "out __SREG__, r0\n\t"
+        "pop r0\n\t"
+        "reti\n\t"
+        :
+        : [eecr] "I" (_SFR_IO_ADDR(EECR)),
+          [eerie] "I" (EERIE)
+    );
+}
+#endif
+
+bool eepromQueueWriteBlock(const void *buffer, uint16_t address, uint8_t length)
+{
+    lockQueue();
+
+    // (Coalescing might mean fewer new entries are needed - but a write that
+    // only just doesn't fit can wait.)
+    const bool fits = length <= sQueueCapacity - sQueueLength;
+    if(fits) {
+        const uint8_t *bytes = (const uint8_t *)buffer;
+        for(; length; --length, ++bytes, ++address) {
+            const uint8_t index = queueIndexForAddress(address);
+            if(index != sQueueCapacity) {
+                sQueueValues[index] = *bytes;
+                continue;
+            }
+
+            const uint8_t newIndex = queueIndex(sQueueLength);
+            sQueueAddresses[newIndex] = address;
+            sQueueValues[newIndex] = *bytes;
+            ++sQueueLength;
+        }
+    }
+
+    unlockQueue();
+    return fits;
+}
+
+void eepromQueueReadBlock(void *out, uint16_t address, uint8_t length)
+{
+    lockQueue();
+
+    uint8_t *bytes = (uint8_t *)out;
+    for(; length; --length, ++bytes, ++address) {
+        const uint8_t index = queueIndexForAddress(address);
+        if(index != sQueueCapacity) {
+            *bytes = sQueueValues[index];
+        } else {
+            *bytes = eeprom_read_byte((const uint8_t *)(intptr_t)address);
+        }
+    }
+
+    unlockQueue();
+}
+
+void eepromQueueFlush()
+{
+    lockQueue();
+    while(sQueueLength) {
+        eeprom_busy_wait();
+        commitOldest();
+    }
+    eeprom_busy_wait();
+    unlockQueue();
+}
+
+bool eepromQueueIsEmpty()
+{
+    return sQueueLength == 0;
+}
+
+uint8_t eepromQueueSpace()
+{
+    return sQueueCapacity - sQueueLength;
+}
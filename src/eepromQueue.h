@@ -0,0 +1,35 @@
+#ifndef __eepromqueue_h_included__
+#define __eepromqueue_h_included__
+
+#include <stdint.h>
+
+// A write-behind queue for the EEPROM.
+//
+// Writing a byte of EEPROM takes several milliseconds, and the avr-libc
+// routines wait for each write to finish before starting the next - so
+// writing a block stalls everything else, including V-USB polling, for a
+// long time. Instead, we queue writes up here, and the EEPROM ready interrupt
+// commits them one byte at a time. The EEPROM hardware carries on with each
+// write while we get on with other things.
+//
+// Reads through the queue see queued data as if it had already been written.
+// Note that reading a byte that's _not_ queued still has to wait for any
+// in-progress byte write to finish.
+//
+// Call these only from the main loop.
+
+// Never waits. Returns false, having queued nothing, if there isn't room for
+// all `length` bytes (see `eepromQueueSpace()`).
+bool eepromQueueWriteBlock(const void *buffer, uint16_t address, uint8_t length);
+void eepromQueueReadBlock(void *out, uint16_t address, uint8_t length);
+
+// Waits until everything queued is written. (It works with interrupts
+// disabled too.)
+void eepromQueueFlush();
+
+bool eepromQueueIsEmpty();
+
+// The number of bytes there's room to queue.
+uint8_t eepromQueueSpace();
+
+#endif // __eepromqueue_h_included__
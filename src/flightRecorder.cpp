@@ -0,0 +1,114 @@
+#include "flightRecorder.h"
+#include "eepromLog.h"
+#include "eepromQueue.h"
+#include "trace.h"
+#include "serial.h"
+#include "packedStrings.h"
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
+
+static const uint8_t sFlightRecordMarker = 0xa5;
+
+// The layout of the record in EEPROM. It's only ever read and written a byte
+// at a time - a whole one would take a big bite out of the stack.
+struct FlightRecord {
+    uint8_t marker;
+    FlightRecorderState state;
+
+    // Oldest first.
+    uint8_t commandHistory[FLIGHT_RECORDER_HISTORY_LENGTH][3];
+    uint8_t events[FLIGHT_RECORDER_EVENT_COUNT][TRACE_RECORD_SIZE];
+
+    uint8_t crc;        // CRC-8 of everything above.
+};
+static_assert(sizeof(FlightRecord) <= FLIGHT_RECORDER_EEPROM_SIZE, "Flight record doesn't fit in its EEPROM region");
+
+static FlightRecord * const sFlightRecordAddress = (FlightRecord *)FLIGHT_RECORDER_EEPROM_ADDRESS;
+
+// Writes `length` bytes at `address`, adding them to `crc`. Returns the address
+// after them.
+static uint8_t *saveBytes(uint8_t *address, const uint8_t *bytes, uint8_t length, uint8_t *crc)
+{
+    for(; length; --length, ++bytes, ++address) {
+        *crc = _crc8_ccitt_update(*crc, *bytes);
+        eeprom_update_byte(address, *bytes);
+    }
+    return address;
+}
+
+void flightRecorderSave(const FlightRecorderState *state, const uint8_t (*commandHistory)[3], const uint8_t commandHistoryCursor)
+{
+    // Save anything the EEPROM log still has to first, so it's not lost,
+    // and so the log stays consistent.
+    eepromLogFlush();
+
+    // The CRC is written last, so a record is only valid once it's complete.
+    uint8_t crc = 0;
+    uint8_t *address = (uint8_t *)sFlightRecordAddress;
+    address = saveBytes(address, &sFlightRecordMarker, sizeof(sFlightRecordMarker), &crc);
+    address = saveBytes(address, (const uint8_t *)state, sizeof(*state), &crc);
+    for(uint8_t i = 0; i < FLIGHT_RECORDER_HISTORY_LENGTH; ++i) {
+        const uint8_t *entry = commandHistory[(uint8_t)(commandHistoryCursor + 1 + i) % FLIGHT_RECORDER_HISTORY_LENGTH];
+        address = saveBytes(address, entry, 3, &crc);
+    }
+    uint8_t events[FLIGHT_RECORDER_EVENT_COUNT][TRACE_RECORD_SIZE];
+    traceCopyLatest(&events[0][0], FLIGHT_RECORDER_EVENT_COUNT);
+    address = saveBytes(address, &events[0][0], sizeof(events), &crc);
+    eeprom_update_byte(address, crc);
+}
+
+// (Through the write queue, so we see a queued clear, and don't get in the
+// way of its writes.)
+static uint8_t readByte(const uint8_t offset)
+{
+    uint8_t byte;
+    eepromQueueReadBlock(&byte, (uint16_t)(intptr_t)sFlightRecordAddress + offset, 1);
+    return byte;
+}
+
+static bool recordIsValid()
+{
+    if(readByte(offsetof(FlightRecord, marker)) != sFlightRecordMarker) {
+        return false;
+    }
+    uint8_t crc = 0;
+    for(uint8_t i = 0; i < offsetof(FlightRecord, crc); ++i) {
+        crc = _crc8_ccitt_update(crc, readByte(i));
+    }
+    return crc == readByte(offsetof(FlightRecord, crc));
+}
+
+bool flightRecorderPrint()
+{
+    if(!recordIsValid()) {
+        return false;
+    }
+
+    serialPrintStr6(STR6("\nFLIGHT\n"), true);
+    for(uint8_t i = 0; i < sizeof(FlightRecord); ++i) {
+        serialPrintHex(readByte(i), true);
+        serialPrint((i % 16) == 15 ? '\n' : ' ', true);
+    }
+    serialPrintStr6(STR6("\nEND\n"), true);
+    return true;
+}
+
+uint8_t flightRecorderRead(uint8_t *out, const uint8_t offset, uint8_t length)
+{
+    if(offset >= sizeof(FlightRecord)) {
+        return 0;
+    }
+    if(length > sizeof(FlightRecord) - offset) {
+        length = sizeof(FlightRecord) - offset;
+    }
+    eepromQueueReadBlock(out, (uint16_t)(intptr_t)sFlightRecordAddress + offset, length);
+    return length;
+}
+
+bool flightRecorderClear()
+{
+    const uint8_t noMarker = 0xff;
+    return eepromQueueWriteBlock(&noMarker, (uint16_t)(intptr_t)&sFlightRecordAddress->marker, sizeof(noMarker));
+}
@@ -0,0 +1,52 @@
+#ifndef __flightrecorder_h_included__
+#define __flightrecorder_h_included__
+
+#include <stdint.h>
+#include <avr/io.h>
+
+// Keeps a record of what was going on when we halted, in EEPROM, so it can
+// be looked at after a reset - even if nothing was listening on the serial
+// port at the time.
+//
+// At the next startup, the record is printed over serial as a hex dump between
+// 'FLIGHT' and 'END' lines, which `decode_flight_record.py`, in the project
+// directory, can turn into something readable. It's kept until it's cleared
+// - by the serial console (see console.h), or over USB (see
+// `usbFunctionWriteOutOrAbandon()` in main.cpp) - or the next halt replaces
+// it. Its raw bytes can be read over USB too, so it can be looked at without
+// a serial port.
+
+// The reserved region, just below the EEPROM magic number at the end of the
+// EEPROM (see `prepareEEPROM()`). The EEPROM log gets everything before it.
+#define FLIGHT_RECORDER_EEPROM_SIZE 136
+#define FLIGHT_RECORDER_EEPROM_ADDRESS ((E2END + 1) - 3 - FLIGHT_RECORDER_EEPROM_SIZE)
+
+#define FLIGHT_RECORDER_HISTORY_LENGTH 32
+#define FLIGHT_RECORDER_EVENT_COUNT 8
+
+struct FlightRecorderState {
+    uint8_t haltCode;
+    uint8_t osccal;
+    uint8_t dualShockMode;
+    uint8_t dualShockCommandQueueCursor;
+};
+
+// Writes the record, waiting for the EEPROM. Only for use when halting -
+// it takes around half a second.
+// `commandHistory` is the ring of 3 byte entries kept by main.cpp, with
+// `commandHistoryCursor` pointing at the latest.
+void flightRecorderSave(const FlightRecorderState *state, const uint8_t (*commandHistory)[3], const uint8_t commandHistoryCursor);
+
+// Prints the record, if there is one. Returns false if there isn't.
+bool flightRecorderPrint();
+
+// Copies up to `length` bytes of the record's raw bytes, from `offset`, to
+// `out` - valid record or not. Returns how many there were. (There are
+// FLIGHT_RECORDER_EEPROM_SIZE, at most.)
+uint8_t flightRecorderRead(uint8_t *out, const uint8_t offset, uint8_t length);
+
+// Marks the region as holding no record (through the EEPROM write queue).
+// Returns false if the queue had no room - try again later.
+bool flightRecorderClear();
+
+#endif // __flightrecorder_h_included__
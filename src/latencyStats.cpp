@@ -0,0 +1,144 @@
+#include "latencyStats.h"
+
+#if LATENCY_STATS_ON
+
+#include "timer.h"
+#include "serial.h"
+#include "packedStrings.h"
+
+#include <string.h>
+
+// 100us (20 tick) buckets, up to 1.6ms. The last bucket counts everything
+// longer.
+static const uint8_t sBucketTicks = 20;
+static const uint8_t sBucketCount = 17;
+
+struct LatencyStatistic {
+    uint16_t minimum;
+    uint16_t maximum;
+    uint32_t total;
+    uint16_t count;
+};
+
+static uint16_t sHistogram[sBucketCount];
+static LatencyStatistic sSampleToDelivery = { 0xffff, 0, 0, 0 };
+static LatencyStatistic sSampleToHandOff = { 0xffff, 0, 0, 0 };
+static LatencyStatistic sDeliveryInterval = { 0xffff, 0, 0, 0 };
+
+static uint16_t sSampleTime;
+static uint16_t sLastDeliveryTime;
+
+// Where we are in following a sample through to delivery.
+enum LatencyState : uint8_t {
+    LATENCY_IDLE,
+    LATENCY_SAMPLED,
+    LATENCY_HANDED_OFF,
+};
+static LatencyState sState = LATENCY_IDLE;
+static bool sHaveLastDelivery = false;
+
+static void resetStatistic(LatencyStatistic *statistic)
+{
+    memset(statistic, 0, sizeof(*statistic));
+    statistic->minimum = 0xffff;
+}
+
+static void addToStatistic(LatencyStatistic *statistic, const uint16_t ticks)
+{
+    // Stop counting before anything overflows - 65535 samples is plenty.
+    if(statistic->count == 0xffff) {
+        return;
+    }
+    if(ticks < statistic->minimum) {
+        statistic->minimum = ticks;
+    }
+    if(ticks > statistic->maximum) {
+        statistic->maximum = ticks;
+    }
+    statistic->total += ticks;
+    ++statistic->count;
+}
+
+static void reset()
+{
+    memset(sHistogram, 0, sizeof(sHistogram));
+    resetStatistic(&sSampleToDelivery);
+    resetStatistic(&sSampleToHandOff);
+    resetStatistic(&sDeliveryInterval);
+    sState = LATENCY_IDLE;
+    sHaveLastDelivery = false;
+}
+
+void latencyStatsSampled()
+{
+    sSampleTime = timerTicks();
+    sState = LATENCY_SAMPLED;
+}
+
+void latencyStatsHandedOff()
+{
+    if(sState == LATENCY_SAMPLED) {
+        addToStatistic(&sSampleToHandOff, timerTicksSince(sSampleTime));
+        sState = LATENCY_HANDED_OFF;
+    }
+}
+
+void latencyStatsDelivered()
+{
+    if(sState != LATENCY_HANDED_OFF) {
+        return;
+    }
+    sState = LATENCY_IDLE;
+
+    const uint16_t now = timerTicks();
+    const uint16_t latency = timerTicksSince(sSampleTime);
+    addToStatistic(&sSampleToDelivery, latency);
+
+    uint16_t bucket = latency / sBucketTicks;
+    if(bucket >= sBucketCount) {
+        bucket = sBucketCount - 1;
+    }
+    if(sHistogram[bucket] != 0xffff) {
+        ++sHistogram[bucket];
+    }
+
+    if(sHaveLastDelivery) {
+        addToStatistic(&sDeliveryInterval, timerTicksSince(sLastDeliveryTime));
+    }
+    sLastDeliveryTime = now;
+    sHaveLastDelivery = true;
+}
+
+static void printStatistic(const uint8_t *nameStr6, const LatencyStatistic *statistic)
+{
+    serialPrintStr6(nameStr6, true);
+    if(statistic->count) {
+        serialPrintHex16(statistic->minimum, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->total / statistic->count, true);
+        serialPrint(' ', true);
+        serialPrintHex16(statistic->maximum, true);
+    }
+    serialPrint('\n', true);
+}
+
+void latencyStatsDump()
+{
+    // All in hex, and in 5us ticks. Statistics are 'minimum mean maximum'.
+    serialPrintStr6(STR6("\nLATENCY "), true);
+    serialPrintHex16(sSampleToDelivery.count, true);
+    serialPrint('\n', true);
+    for(uint8_t i = 0; i < sBucketCount; ++i) {
+        serialPrintHex16(i * sBucketTicks, true);
+        serialPrint(' ', true);
+        serialPrintHex16(sHistogram[i], true);
+        serialPrint('\n', true);
+    }
+    printStatistic(STR6("DELIVERY "), &sSampleToDelivery);
+    printStatistic(STR6("HANDOFF "), &sSampleToHandOff);
+    printStatistic(STR6("INTERVAL "), &sDeliveryInterval);
+
+    reset();
+}
+
+#endif
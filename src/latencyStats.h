@@ -0,0 +1,41 @@
+#ifndef __latencystats_h_included__
+#define __latencystats_h_included__
+
+#include <stdint.h>
+
+// Measures how old the DualShock's state is by the time the Switch collects
+// the packet containing it, so that changes to scheduling, polling, etc. can
+// be compared with numbers rather than by feel.
+//
+// Three points are timestamped (in `timerTicks()`, so 5us units):
+//  - 'sample': the DualShock poll finishing.
+//  - 'hand-off': the packet containing it being given to `usbSetInterrupt()`.
+//  - 'delivery': V-USB's interrupt buffer being free again - i.e. the Switch
+//    has collected the packet. (Only noticed when the main loop gets round to
+//    it, so this is an upper bound.)
+// Sample to delivery times are accumulated in a histogram, along with the
+// minimum, maximum and mean of that, of sample to hand-off, and of the
+// interval between deliveries (the jitter of the report rate).
+//
+// Off by default - it costs around 75 bytes of RAM.
+
+#ifndef LATENCY_STATS_ON
+#define LATENCY_STATS_ON 0
+#endif
+
+#if LATENCY_STATS_ON
+void latencyStatsSampled();
+void latencyStatsHandedOff();
+void latencyStatsDelivered();
+
+// Prints everything over serial (waiting for space in the buffer), then
+// starts again from scratch.
+void latencyStatsDump();
+#else
+static inline void latencyStatsSampled() {}
+static inline void latencyStatsHandedOff() {}
+static inline void latencyStatsDelivered() {}
+static inline void latencyStatsDump() {}
+#endif
+
+#endif // __latencystats_h_included__
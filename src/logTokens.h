@@ -0,0 +1,43 @@
+#ifndef __logtokens_h_included__
+#define __logtokens_h_included__
+
+// The messages that can be logged in tokenized form (see
+// `DEBUG_PRINT_TOKENIZED` in serial.h).
+//
+// Rather than sending text, a tokenized log event is sent as a frame of:
+//     0x80 | id, argument length, arguments...
+// - where 'id' is the message's position in the list below. None of the
+// format strings end up in the firmware - `decode_serial_log.py`, in the
+// project directory, reads them from this file to turn the frames back into
+// text. Plain text can still be mixed in (it's all 7-bit, so it never looks
+// like the start of a frame).
+//
+// Format strings are C-style, with these (little-endian) arguments:
+//     %b - a byte, in hex.
+//     %w - a 16-bit word, in hex.
+//     %l - a 32-bit long, in hex.
+//     %d - a byte, in decimal.
+//     %* - all of the remaining bytes, in hex, space separated.
+//
+// Only add to the end of this list, so that old logs still decode.
+
+#define LOG_MESSAGES \
+    LOG_MESSAGE(LOG_OUT_PACKET_FIRST, "\n/ -> %*") \
+    LOG_MESSAGE(LOG_OUT_PACKET_MORE, "\n| ...%*") \
+    LOG_MESSAGE(LOG_OUT_REPORT, "\n\\ %b:%b") \
+    LOG_MESSAGE(LOG_UART_COMMAND, "|%b") \
+    LOG_MESSAGE(LOG_SPI_READ, "<%l,%b") \
+    LOG_MESSAGE(LOG_SPI_WRITE, ">%l,%b") \
+    LOG_MESSAGE(LOG_RUMBLE_ENABLED, " Rumble %d") \
+    LOG_MESSAGE(LOG_RUMBLE_AMPLITUDES, " Rumble: (%d,%d)") \
+
+enum LogTokenId {
+#define LOG_MESSAGE(id, format) id,
+    LOG_MESSAGES
+#undef LOG_MESSAGE
+    LOG_TOKEN_COUNT
+};
+
+static_assert(LOG_TOKEN_COUNT <= 0x80, "Too many log messages for a one byte token");
+
+#endif // __logtokens_h_included__
@@ -1,15 +1,26 @@
 #include "serial.h"
+#include "logTokens.h"
 #include "timer.h"
 #include "spiMemory.h"
+#include "eepromQueue.h"
+#include "eepromLog.h"
+#include "flightRecorder.h"
 #include "packedStrings.h"
+#include "trace.h"
+#include "latencyStats.h"
+#include "ackTiming.h"
+#include "benchmark.h"
+#include "tuning.h"
+#include "console.h"
 
 #include "descriptors.h"
 #include "rumble.h"
+#include "rumbleEnvelope.h"
+#include "rumbleGovernor.h"
 #include "compile_time_mac.h"
 
 #include <stdlib.h>
 #include <stddef.h>
-#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <stddef.h>
@@ -20,6 +31,10 @@
 #include <avr/sleep.h>
 #include <util/delay.h>
 
+#ifdef AVR_HOST
+#include <avrHost.h>
+#endif
+
 extern "C" {
     #include <usbdrv/usbdrv.h>
 
@@ -27,24 +42,66 @@ extern "C" {
     // routine.
     uint8_t lastTimer0Value = 0;
 
+    // V-USB only declares this with flow control on, but the main loop
+    // checks it to know whether `usbPoll()` has a message to handle.
+    extern volatile schar usbRxLen;
+
     void usbFunctionRxHook(const uchar *data, const uchar len);
 }
 
-#define EEPROM_MAGIC 0x0007
+// Idle the CPU between bits of work while USB is up, rather than spinning
+// around the main loop.
+#ifndef IDLE_SLEEP_ON
+#define IDLE_SLEEP_ON 1
+#endif
+
+// 0x0007 was the layout before the EEPROM log, with user calibration stored
+// in place at address 0. 0x0008 was the log filling the whole EEPROM, before
+// the flight recorder's region was reserved.
+#define EEPROM_MAGIC 0x0009
+static uint16_t * const sEepromMagicAddress = ((uint16_t *)E2END) - 1;
+
+// Set while the EEPROM log is erasing what was in the EEPROM before we got it.
+// We only write our magic number once that's done, so if the power goes
+// before then, we'll start again next time.
+static bool sEepromMagicPending = false;
+
 void prepareEEPROM()
 {
-    static uint16_t * const lastInt16 = ((uint16_t *)E2END) - 1;
-    uint16_t serial = eeprom_read_word(lastInt16);
+    uint16_t serial = eeprom_read_word(sEepromMagicAddress);
     if(serial != EEPROM_MAGIC) {
+        // Erasing the whole EEPROM here would hold up USB enumeration for
+        // hundreds of milliseconds, so the log starts empty and erases it in
+        // the background instead (see `pollEEPROM()`).
         debugPrintStr6(STR6("EEPROM\n"));
-        for(uint16_t *cursor = 0; cursor < lastInt16; ++cursor) {
-            eeprom_update_word(cursor, 0xffff);
+        eepromLogFormat();
+        flightRecorderClear();
+        sEepromMagicPending = true;
+    } else {
+        eepromLogInit();
+
+        // If we halted last time, tell whoever's listening why.
+        flightRecorderPrint();
+    }
+}
+
+void pollEEPROM()
+{
+    // (This also saves what the Switch has written, in the background.)
+    const bool erased = eepromLogPoll();
+    if(sEepromMagicPending && erased) {
+        const uint16_t magic = EEPROM_MAGIC;
+        if(eepromQueueWriteBlock(&magic, (uint16_t)(intptr_t)sEepromMagicAddress, sizeof(magic))) {
+            sEepromMagicPending = false;
+            //debugPrintStr6(STR6("Cleared\n"));
         }
-        eeprom_update_word(lastInt16, EEPROM_MAGIC);
-        //debugPrintStr6(STR6("Cleared\n"));
     }
 }
 
+#if BENCHMARK_ON
+static void runBenchmarks();
+#endif
+
 void setup()
 {
     // The oscilator is calibrated to 12.8MHz based on 1ms timing of USB frames
@@ -60,13 +117,14 @@ void setup()
     OSCCAL = 226;
 #endif
 
-    // Set up sleep mode. This doesn't actually put the device to sleep yet -
-    // It just sets the mode that will be used when `sleep_cpu()` is called.
-    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    // Allow sleep. This doesn't actually put the device to sleep yet - that
+    // happens when `sleep_cpu()` is called, in whichever mode the main loop
+    // sets beforehand.
     sleep_enable();
 
     // Initialize our utility functions.
     timerInit();
+    ackTimingInit();
     serialInit(266667);
 
     prepareEEPROM();
@@ -94,6 +152,9 @@ void setup()
     // Double the SPI rate defined above (so 200kHz * 2 = 400kHz)
     SPSR |= 1 << SPI2X;
 
+    // (This may change the SPI rate above, if it's been tuned.)
+    tuningInit();
+
     // Need to set the controller's 'Chip Select', which is active-low, to high
     // so we can pull it low for each transaction.
     // PICO and SCK should rest at high too.
@@ -110,6 +171,11 @@ void setup()
     EIMSK |= 1 << INT1;
 #endif
 
+#if BENCHMARK_ON
+    // (Before USB starts up - it would only get in the way.)
+    runBenchmarks();
+#endif
+
     // Disable interrupts for USB reset.
     cli();
 
@@ -128,6 +194,7 @@ void setup()
 }
 
 static const uint8_t sReportSize = 64;
+static_assert(sizeof(SwitchReport) == 11, "SwitchReport must match the Pro Controller's layout");
 
 static uint8_t sReports[2][sReportSize];
 static uint8_t sReportsInputReportPosition[2] = { 0 };
@@ -142,11 +209,20 @@ static uint8_t sCommandHistory[sCommandHistoryLength][3] = {0};
 static uint8_t sCommandHistoryCursor = 0;
 
 static bool sRumbleEnabled = false;
-static uint8_t sLowRumbleAmplitude = 0;
-static uint8_t sHighRumbleAmplitude = 0;
+
+// Used by `prepareInputSubReportInBuffer()` - but kept out here so that they
+// can be saved by the flight recorder if we halt.
+static uint8_t sDualShockMode = 0;
+static uint8_t sDualShockCommandQueueCursor = 0;
 
 static void haltStr6(uint8_t i, const uint8_t *messageStr6 = NULL)
 {
+    // Save what we can for after the reset first, in case nobody's listening
+    // to the serial port.
+    const FlightRecorderState state = { i, OSCCAL, sDualShockMode, sDualShockCommandQueueCursor };
+    flightRecorderSave(&state, sCommandHistory, sCommandHistoryCursor);
+
+    traceDump();
     serialPrintStr6(STR6("HALT: 0x"), true);
     serialPrintHex(i, true);
     if(messageStr6) {
@@ -169,6 +245,9 @@ static void haltStr6(uint8_t i, const uint8_t *messageStr6 = NULL)
         }
     }
 
+#ifdef AVR_HOST
+    avrHostHalt();
+#endif
     while(true);
 }
 
@@ -176,19 +255,43 @@ static void haltStr6(uint8_t i, const uint8_t *messageStr6 = NULL)
 static volatile bool sDualShockAcknowledgeReceived = false;
 ISR(INT1_vect, ISR_NOBLOCK)
 {
+    ackTimingAcknowledged();
+
     // Set the flag so that the main code can know about the acknowledgement.
     sDualShockAcknowledgeReceived = true;
 }
 
+// Waits for _at least_ `micros` microseconds (the loop adds a little).
+static void delayMicros(uint8_t micros)
+{
+    while(micros--) {
+        _delay_us(1);
+    }
+}
+
+#if BENCHMARK_ON
+// If set, `dualShockCommand()` returns this instead of talking to a Dual Shock,
+// so the benchmarks can time what's done with its reply.
+static const DualShockReport *sBenchmarkDualShockReply = NULL;
+#endif
+
 static uint8_t dualShockCommand(const uint8_t *command, const uint8_t commandLength,
     uint8_t *toReceive, const uint8_t toReceiveLength)
 {
+#if BENCHMARK_ON
+    if(sBenchmarkDualShockReply) {
+        const uint8_t replyLength = toReceiveLength < sizeof(DualShockReport) ? toReceiveLength : sizeof(DualShockReport);
+        memcpy(toReceive, sBenchmarkDualShockReply, replyLength);
+        return replyLength;
+    }
+#endif
+
     // Pull-down the ~CS ('Attention') line.
     PORTB &= ~(1 << 2);
 
     // Give the controller a little time to notice (this seems to be necessary
     // for reliable communication).
-    _delay_us(20);
+    delayMicros(tuningGet(TUNING_SELECT_DELAY));
 
     // Loop using SPI hardware to send/receive each byte in the command.
     uint8_t byteIndex = 0;
@@ -220,6 +323,7 @@ static uint8_t dualShockCommand(const uint8_t *command, const uint8_t commandLen
         // Grab the received byte from the SPI Data register.
         // This has the side-effect of clearing the SPIF flag (see above).
         const uint8_t received = SPDR;
+        ackTimingByteSent(byteIndex);
 
         // Process what we've received.
         if(byteIndex == 1) {
@@ -248,9 +352,9 @@ static uint8_t dualShockCommand(const uint8_t *command, const uint8_t commandLen
         // Wait for the Dual Shock to acknowledge the byte.
         // All bytes except the last one(?!) are acknowledged.
         if(byteIndex < reportedTransactionLength) {
-            uint8_t microsWaited = 0;
+            const uint16_t waitStartTicks = timerTicks();
             while(!byteAcknowledged) {
-                if(microsWaited > 100) {
+                if(timerTicksSince(waitStartTicks) > 100 / TIMER_MICROS_PER_TICK) {
                     // Sometimes, especially when it's in command mode, the Dual
                     // Shock seems to get into a bad state and 'give up'.
                     // Detect this and bail.
@@ -259,17 +363,16 @@ static uint8_t dualShockCommand(const uint8_t *command, const uint8_t commandLen
                     errored = true;
                     break;
                 }
-                _delay_us(2);
-                microsWaited += 2;
                 byteAcknowledged = sDualShockAcknowledgeReceived;
             }
+            ackTimingWaitFinished();
         }
     } while(!errored && byteIndex < reportedTransactionLength);
 
     // Despite the fact that the controller doens't raise the acknowledge line
     // for the last byte, we still seem to need to wait a bit for communication
     // to be reliable :-|.
-    _delay_us(20);
+    delayMicros(tuningGet(TUNING_DESELECT_DELAY));
 
     // ~CS line ('Attention') needs to be raised to its inactive state between
     // each transaction.
@@ -297,6 +400,15 @@ static uint16_t eightBitToTwelveBit(const uint16_t eightBit)
 #endif
 }
 
+// Snaps a raw Dual Shock stick value to center if it's within the (tunable)
+// deadzone.
+static uint8_t applyStickDeadzone(const uint8_t value)
+{
+    const uint8_t deadzone = tuningGet(TUNING_STICK_DEADZONE);
+    const uint8_t distanceFromCenter = value >= 0x80 ? value - 0x80 : 0x80 - value;
+    return distanceFromCenter < deadzone ? 0x80 : value;
+}
+
 // Weird extern declaration to keep VS Code happy. It's not actually necessary
 // for compilation, but Intellisense can't find a declaration when editing
 extern uint8_t (__builtin_avr_insert_bits)(uint32_t, uint8_t, uint8_t);
@@ -349,17 +461,17 @@ static void convertDualShockToSwitch(const DualShockReport *dualShockReport, Swi
     // If the three bytes (with two nybbles each) are AB CD EF,
     // the decoded 12-bit values are DAB, EFC. It makes more sense 'backwards'?
 
-    uint8_t leftStickX = dualShockReport->leftStickX;
+    uint8_t leftStickX = applyStickDeadzone(dualShockReport->leftStickX);
     uint16_t leftStickX12 = eightBitToTwelveBit(leftStickX);
-    uint8_t leftStickY = 0xff - dualShockReport->leftStickY;
+    uint8_t leftStickY = 0xff - applyStickDeadzone(dualShockReport->leftStickY);
     uint16_t leftStickY12 = eightBitToTwelveBit(leftStickY);
     switchReport->leftStick[2] = leftStickY12 >> 4;
     switchReport->leftStick[1] = (leftStickY12 << 4) | (leftStickX12 >> 8);
     switchReport->leftStick[0] = leftStickX12 & 0xff;
 
-    uint8_t rightStickX = dualShockReport->rightStickX;
+    uint8_t rightStickX = applyStickDeadzone(dualShockReport->rightStickX);
     uint16_t rightStickX12 = eightBitToTwelveBit(rightStickX);
-    uint8_t rightStickY = 0xff - dualShockReport->rightStickY;
+    uint8_t rightStickY = 0xff - applyStickDeadzone(dualShockReport->rightStickY);
     uint16_t rightStickY12 = eightBitToTwelveBit(rightStickY);
     switchReport->rightStick[2] = rightStickY12 >> 4;
     switchReport->rightStick[1] = (rightStickY12 << 4) | (rightStickX12 >> 8);
@@ -370,20 +482,16 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
 {
     SwitchReport *switchReport = (SwitchReport *)buffer;
 
-    struct DualShockCommand {
-        const uint8_t length;
-        const uint8_t commandSequence[];
-    };
-
+    // Each command is its length, followed by the bytes to send.
     // second-to-last and last byte are small motor (on/off?),
     // large motor (~0x40-0xff?)
-    static const PROGMEM DualShockCommand pollCommand[] = { { 2, { 0x42, 0x00 } } };
-    static const PROGMEM DualShockCommand enterConfigCommand[] = { { 3, { 0x43, 0x00, 0x01 } } };
-    static const PROGMEM DualShockCommand exitConfigCommand[] = { { 3, { 0x43, 0x00, 0x00 } } };
-    static const PROGMEM DualShockCommand switchToAnalogCommand[] = { { 3, { 0x44, 0x00, 0x01 } } };
-    static const PROGMEM DualShockCommand setUpMotorsCommand[] = { { 8, { 0x4D, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF } } };
+    static const PROGMEM uint8_t pollCommand[] = { 2, 0x42, 0x00 };
+    static const PROGMEM uint8_t enterConfigCommand[] = { 3, 0x43, 0x00, 0x01 };
+    static const PROGMEM uint8_t exitConfigCommand[] = { 3, 0x43, 0x00, 0x00 };
+    static const PROGMEM uint8_t switchToAnalogCommand[] = { 3, 0x44, 0x00, 0x01 };
+    static const PROGMEM uint8_t setUpMotorsCommand[] = { 8, 0x4D, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF };
 
-    static const PROGMEM DualShockCommand *const enterAnalogCommandSequence[] = {
+    static const PROGMEM uint8_t *const enterAnalogCommandSequence[] = {
         enterConfigCommand,
         switchToAnalogCommand,
         setUpMotorsCommand,
@@ -393,8 +501,7 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
     static DualShockReport dualShockReports[2] = { EMPTY_DUAL_SHOCK_REPORT, EMPTY_DUAL_SHOCK_REPORT };
     static uint8_t previousDualShockReportIndex = 0;
 
-    static const DualShockCommand * const *commandQueue;
-    static uint8_t commandQueueCursor = 0;
+    static const uint8_t * const *commandQueue;
     static uint8_t commandQueueLength = 0;
 
     static bool analogButtonIsPressed = false;
@@ -403,28 +510,39 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
     uint8_t replyLength = 0;
     uint8_t thisDualShockReportIndex = (uint8_t)(previousDualShockReportIndex + 1) % 2;
 
-    const bool executingCommandQueue = (commandQueueCursor < commandQueueLength);
-    const DualShockCommand *commandToExecute_P;
+    const bool executingCommandQueue = (sDualShockCommandQueueCursor < commandQueueLength);
+    const uint8_t *commandToExecute_P;
 
     if(!executingCommandQueue) {
         // If there's no command queue (the usual case), we just poll
         // controller state.
         commandToExecute_P = pollCommand;
     } else {
-        commandToExecute_P = (DualShockCommand *)pgm_read_ptr(commandQueue + commandQueueCursor);
+        commandToExecute_P = (const uint8_t *)pgm_read_ptr(commandQueue + sDualShockCommandQueueCursor);
     }
 
-    uint8_t commandLength = pgm_read_byte((uint8_t *)commandToExecute_P + offsetof(DualShockCommand, length));
+    uint8_t commandLength = pgm_read_byte(commandToExecute_P);
     uint8_t command[commandLength + 4];
-    memcpy_P(&command, commandToExecute_P + offsetof(DualShockCommand, commandSequence), commandLength);
+    memcpy_P(&command, commandToExecute_P + 1, commandLength);
 
     // Ick to this special-casing...
     if(commandToExecute_P == pollCommand && sRumbleEnabled) {
-        const uint8_t lowRumbleAmplitude = sLowRumbleAmplitude ?: sHighRumbleAmplitude;
-        const uint8_t highRumbleAmplitude = sHighRumbleAmplitude ?: sLowRumbleAmplitude;
+        uint8_t envelopeLowAmplitude;
+        uint8_t envelopeHighAmplitude;
+        rumbleEnvelopeStep(usbSofCount, &envelopeLowAmplitude, &envelopeHighAmplitude);
+
+        // (A scale of 0xff leaves the amplitudes as they are.)
+        const uint16_t rumbleScale = (uint16_t)tuningGet(TUNING_RUMBLE_SCALE) + 1;
+        envelopeLowAmplitude = (envelopeLowAmplitude * rumbleScale) >> 8;
+        envelopeHighAmplitude = (envelopeHighAmplitude * rumbleScale) >> 8;
+
+        const uint8_t lowRumbleAmplitude = envelopeLowAmplitude ?: envelopeHighAmplitude;
+        const uint8_t highRumbleAmplitude = envelopeHighAmplitude ?: envelopeLowAmplitude;
 
         bool highRumbleOn = false;
-        if(highRumbleAmplitude) {
+        // (Amplitudes below 0x10 are too small for even our crude PWM - and
+        // would cause a divide by zero below.)
+        if(highRumbleAmplitude >= 0x10) {
             // The small motor is only either on or off, so we do some crude
             // PWM here to simulate the amplitude.
             static uint8_t activationCount = 0;
@@ -433,19 +551,29 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
             highRumbleOn = (activationCount == 0);
         }
 
+        // Make sure the motors won't draw more current than we're allowed.
+        uint8_t bigMotorAmplitude = lowRumbleAmplitude;
+        rumbleGovernorApply(&bigMotorAmplitude, &highRumbleOn);
+
         commandLength += 2;
         command[2] = highRumbleOn ? 0xff : 0; // Small motor. On = 0xff, Off = anything else. High
-        command[3] = lowRumbleAmplitude; // Big motor. Practical range is 0x40 - 0xff. Low
+        command[3] = bigMotorAmplitude; // Big motor. Practical range is 0x40 - 0xff. Low
     }
 
+    traceEvent(TRACE_POLL_START, command[0]);
     replyLength = dualShockCommand(command,
                                    commandLength,
                                    (uint8_t *)&dualShockReports[thisDualShockReportIndex],
                                    sizeof(DualShockReport));
+    traceEvent(TRACE_POLL_END, replyLength);
+    if(!executingCommandQueue) {
+        latencyStatsSampled();
+    }
 
     if(!executingCommandQueue) {
         if(replyLength >= 2) {
             const uint8_t mode = dualShockReports[thisDualShockReportIndex].deviceMode;
+            sDualShockMode = mode;
 
             if(mode != 0x7) {
                 // If we're _not_ in analog mode, initiate the sequence of
@@ -453,7 +581,7 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
                 // mode. One command is performed every time this function
                 // is called.
                 commandQueue = enterAnalogCommandSequence;
-                commandQueueCursor = 0;
+                sDualShockCommandQueueCursor = 0;
                 commandQueueLength = 4;
 
                 if(mode == 0x4) {
@@ -471,12 +599,12 @@ static void prepareInputSubReportInBuffer(uint8_t *buffer)
     } else {
         if(replyLength >= 2 && dualShockReports[thisDualShockReportIndex].deviceMode == 0xF) {
             // On to the next command!
-            ++commandQueueCursor;
+            ++sDualShockCommandQueueCursor;
         } else {
             // The dual shock seems prome to failure to enter comamnd mode,
             // and to execute commands. If something's gone wrong, just
             // start the queue again.
-            commandQueueCursor = 0;
+            sDualShockCommandQueueCursor = 0;
         }
     }
 
@@ -513,29 +641,43 @@ static void prepareInputReport()
     sReportPending = true;
 }
 
-static void prepareRegularReplyReport_P(uint8_t reportId, uint8_t reportCommand, const uint8_t *reportIn, uint8_t reportInLen)
+// Starts a 'regular' reply report, and returns where in it the caller should
+// put `replyDataLength` bytes of reply data - or NULL if it won't fit.
+static uint8_t *startRegularReplyReport(uint8_t reportId, uint8_t reportCommand, uint8_t replyDataLength)
 {
     if(sReportPending) {
         haltStr6(0, STR6("Report Clash"));
-        return;
+        return NULL;
+    }
+    if(2 + replyDataLength > sReportSize) {
+        haltStr6(0, STR6("Report Too Big"));
+        return NULL;
     }
 
     uint8_t *report = sReports[sCurrentReport];
     report[0] = reportId;
     report[1] = reportCommand;
-    memcpy_P(&report[2], reportIn, reportInLen);
 
-    sReportLengths[sCurrentReport] = 2 + reportInLen;
+    sReportLengths[sCurrentReport] = 2 + replyDataLength;
     sReportPending = true;
+    return &report[2];
 }
 
-static void prepareUartReplyReport_F(uint8_t ack, uint8_t subCommand, const uint8_t *reportIn, uint8_t reportInLen,  void *(*copyFunction)(void *, const void *, size_t))
+static void prepareRegularReplyReport_P(uint8_t reportId, uint8_t reportCommand, const uint8_t *reportIn, uint8_t reportInLen)
 {
-    // '_F' - means pass in function to use for memcpying.
+    uint8_t *replyData = startRegularReplyReport(reportId, reportCommand, reportInLen);
+    if(replyData) {
+        memcpy_P(replyData, reportIn, reportInLen);
+    }
+}
 
+// Starts a 0x21 UART reply report, and returns where in it the caller should
+// put `replyDataLength` bytes of reply data - or NULL if it won't fit.
+static uint8_t *startUartReplyReport(uint8_t ack, uint8_t subCommand, uint8_t replyDataLength)
+{
     if(sReportPending) {
         haltStr6(0, STR6("Report Clash"));
-        return;
+        return NULL;
     }
 
     uint8_t reportLength = 0;
@@ -549,20 +691,33 @@ static void prepareUartReplyReport_F(uint8_t ack, uint8_t subCommand, const uint
     report[reportLength++] = ack;
     report[reportLength++] = subCommand;
 
-    if(reportInLen == 0) {
-        report[reportLength++] = 0x00;
-    } else {
-        const uint8_t reportSizeBeforeCopy = reportLength;
-        reportLength += reportInLen;
-        if(reportLength > sReportSize) {
-            haltStr6(0, STR6("Report Too Big"));
-            return;
-        }
-        copyFunction(&report[reportSizeBeforeCopy], reportIn, reportInLen);
+    uint8_t *replyData = &report[reportLength];
+    reportLength += replyDataLength;
+    if(reportLength > sReportSize) {
+        haltStr6(0, STR6("Report Too Big"));
+        return NULL;
     }
 
     sReportLengths[sCurrentReport] = reportLength;
     sReportPending = true;
+    return replyData;
+}
+
+static void prepareUartReplyReport_F(uint8_t ack, uint8_t subCommand, const uint8_t *reportIn, uint8_t reportInLen,  void *(*copyFunction)(void *, const void *, size_t))
+{
+    // '_F' - means pass in function to use for memcpying.
+
+    if(reportInLen == 0) {
+        uint8_t *replyData = startUartReplyReport(ack, subCommand, 1);
+        if(replyData) {
+            replyData[0] = 0x00;
+        }
+    } else {
+        uint8_t *replyData = startUartReplyReport(ack, subCommand, reportInLen);
+        if(replyData) {
+            copyFunction(replyData, reportIn, reportInLen);
+        }
+    }
 }
 
 static void prepareUartReplyReport_P(uint8_t ack, uint8_t subCommand, const uint8_t *reportIn, uint8_t reportInLen)
@@ -575,47 +730,129 @@ static void prepareUartReplyReport(uint8_t ack, uint8_t subCommand, const uint8_
     return prepareUartReplyReport_F(ack, subCommand, reportIn, reportInLen, memcpy);
 }
 
-static void prepareUartSpiReplyReport_P(uint16_t address, uint8_t replyDataLength)
+static void prepareUartSpiReplyReport_P(uint32_t address, uint8_t replyDataLength)
 {
+    // A real Pro Controller only returns up to 0x1d bytes at a time. We'll
+    // return more - up to the 44 bytes there's space for after the address
+    // and length in the reply report - but don't let an odd request overflow
+    // it.
+    static const uint8_t maxReplyDataLength = sReportSize - (2 + sizeof(SwitchReport) + 2) - 5;
+    if(replyDataLength > maxReplyDataLength) {
+        replyDataLength = maxReplyDataLength;
+    }
 
-    const uint8_t bufferLength = replyDataLength + 5;
-    uint8_t buffer[bufferLength];
-    buffer[0] = (uint8_t)(address & 0xFF);
-    buffer[1] = (uint8_t)(address >> 8);
-    buffer[2] = 0;
-    buffer[3] = 0;
-    buffer[4] = (uint8_t)(replyDataLength);
+    // The Switch reads a burst of these while connecting, so rather than
+    // building the reply in a buffer and copying it into the report, we read
+    // straight from (mostly PROGMEM) SPI memory into the report.
+    // Going further - keeping the common replies in PROGMEM with this header
+    // already in front - would save a few hundred cycles a reply, but cost
+    // around 200 bytes of flash, and gain nothing: the reply starts going out
+    // 9 frames after the request either way, paced by the one packet per
+    // frame that the interrupt endpoint gets.
+    uint8_t *replyData = startUartReplyReport(0x90, 0x10, 5 + replyDataLength);
+    if(!replyData) {
+        return;
+    }
+    replyData[0] = (uint8_t)(address);
+    replyData[1] = (uint8_t)(address >> 8);
+    replyData[2] = (uint8_t)(address >> 16);
+    replyData[3] = (uint8_t)(address >> 24);
+    replyData[4] = (uint8_t)(replyDataLength);
 
-    bool spiReadSuccess = spiMemoryRead(&buffer[5], address, replyDataLength);
+    bool spiReadSuccess = spiMemoryRead(&replyData[5], address, replyDataLength);
 
     if(!spiReadSuccess) {
-        haltStr6(address, STR6("Bad SPI"));
+        // We still reply (with 0xffs) - the Switch can cope with that better
+        // than with no reply.
+        debugPrintStr6(STR6(" Bad SPI"));
     }
+}
 
-    return prepareUartReplyReport(0x90, 0x10, buffer, bufferLength);
+// The busiest debug messages - see logTokens.h. Each is either sent as a
+// tokenized log event, or printed as text.
+#if DEBUG_PRINT_TOKENIZED
+static void logOutPacket(const bool first, const uint8_t *data, const uint8_t len)
+{
+    debugPrintTokenBuffer(first ? LOG_OUT_PACKET_FIRST : LOG_OUT_PACKET_MORE, data, len);
 }
 
-uint8_t highestByteFromNBytes(int count, ...)
+static void logOutReport(const uint8_t reportId, const uint8_t commandOrSequenceNumber)
 {
-    va_list args;
-    va_start(args, count);
+    debugPrintToken(LOG_OUT_REPORT, reportId, commandOrSequenceNumber);
+}
 
-    uint8_t highestByte = 0;
+static void logUartCommand(const uint8_t uartCommand)
+{
+    debugPrintToken(LOG_UART_COMMAND, uartCommand);
+}
 
-    for (int i = 0; i < count; i++)
-    {
-        uint8_t value = uint8_t(va_arg(args, int));
-        if (value > highestByte)
-        {
-            highestByte = value;
-        }
+static void logSpiAccess(const LogTokenId id, const uint32_t address, const uint8_t length)
+{
+    debugPrintToken(id, TOKEN_LONG(address), length);
+}
+
+static void logRumbleEnabled(const uint8_t enabled)
+{
+    debugPrintToken(LOG_RUMBLE_ENABLED, enabled);
+}
+
+static void logRumbleAmplitudes(const uint8_t low, const uint8_t high)
+{
+    debugPrintToken(LOG_RUMBLE_AMPLITUDES, low, high);
+}
+#else
+static void logOutPacket(const bool first, const uint8_t *data, const uint8_t len)
+{
+    if(first) {
+        debugPrintStr6(STR6("\n/ -> ")) ;
+    } else {
+        debugPrintStr6(STR6("\n| ...")) ;
+    }
+    for(uint8_t i = 0; i < len; ++i) {
+        debugPrintHex(data[i]);
+        debugPrint(' ');
     }
+}
+
+static void logOutReport(const uint8_t reportId, const uint8_t commandOrSequenceNumber)
+{
+    debugPrintStr6(STR6("\n\\ ")) ;
+    debugPrintHex(reportId);
+    debugPrint(':');
+    debugPrintHex(commandOrSequenceNumber);
+}
+
+static void logUartCommand(const uint8_t uartCommand)
+{
+    debugPrint('|');
+    debugPrintHex(uartCommand);
+}
 
-    va_end(args);
+static void logSpiAccess(const LogTokenId id, const uint32_t address, const uint8_t length)
+{
+    debugPrint(id == LOG_SPI_READ ? '<' : '>');
+    debugPrintHex16(address >> 16);
+    debugPrintHex16(address);
+    debugPrint(',');
+    debugPrintHex16(length);
+}
 
-    return highestByte;
+static void logRumbleEnabled(const uint8_t enabled)
+{
+    debugPrintStr6(STR6(" Rumble")) ;
+    debugPrintStr6(enabled ? STR6(" enabled") : STR6(" disabled"));
 }
 
+static void logRumbleAmplitudes(const uint8_t low, const uint8_t high)
+{
+    debugPrintStr6(STR6(" Rumble: ("));
+    debugPrintDec(low);
+    debugPrint(',');
+    debugPrintDec(high);
+    debugPrint(')');
+}
+#endif
+
 static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAbandonAccumulatedReport)
 {
     static uint8_t reportId;
@@ -630,16 +867,12 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
         return;
     }
 
+    traceEvent(TRACE_OUT_PACKET, len);
+
     if(accumulatedReportBytes == 0) {
         reportId = data[0];
-        debugPrintStr6(STR6("\n/ -> ")) ;
-    } else {
-        debugPrintStr6(STR6("\n| ...")) ;
-    }
-    for(uint8_t i = 0; i < len; ++i) {
-        debugPrintHex(data[i]);
-        debugPrint(' ');
     }
+    logOutPacket(accumulatedReportBytes == 0, data, len);
 
     // USB signifies end-of-transfer as either a 'short' packet (not 8 bytes), or
     //  reaching the maximum size.
@@ -671,10 +904,7 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
     // Deal with the report!
     const uint8_t commandOrSequenceNumber = reportIn[1];
     uint8_t uartCommand = 0;
-    debugPrintStr6(STR6("\n\\ ")) ;
-    debugPrintHex(reportId);
-    debugPrint(':');
-    debugPrintHex(commandOrSequenceNumber);
+    logOutReport(reportId, commandOrSequenceNumber);
 
     switch(reportId) {
     case 0x80: {
@@ -707,6 +937,32 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
             //  following it. A second handshake is required for the baud switch to work."
             prepareRegularReplyReport_P(0x81, command, NULL, 0);
         } break;
+        case 0xf0: {
+            // Ours, not the Switch's: read the flight record (see
+            // flightRecorder.h) without a serial port. `80 F0 <offset>`
+            // replies `81 F0 <offset> <length> <bytes...>`, with as many of
+            // the record's raw bytes from the offset as fit - none past the
+            // end.
+            static const uint8_t maxReplyDataLength = sReportSize - 2 - 2;
+            const uint8_t offset = reportLength > 2 ? reportIn[2] : 0;
+            uint8_t *replyData = startRegularReplyReport(0x81, command, 2 + maxReplyDataLength);
+            if(replyData) {
+                const uint8_t length = flightRecorderRead(&replyData[2], offset, maxReplyDataLength);
+                replyData[0] = offset;
+                replyData[1] = length;
+                // (Trimmed to what there was.)
+                sReportLengths[sCurrentReport] = 2 + 2 + length;
+            }
+        } break;
+        case 0xf1: {
+            // Ours too: clear the flight record. `81 F1 01` if it worked,
+            // `81 F1 00` if the EEPROM was too busy - try again.
+            const uint8_t cleared = flightRecorderClear();
+            uint8_t *replyData = startRegularReplyReport(0x81, command, 1);
+            if(replyData) {
+                replyData[0] = cleared;
+            }
+        } break;
         default: {
             haltStr6(uartCommand, STR6("Bad 'regular' subcommand")) ;
             prepareRegularReplyReport_P(0x81, command, NULL, 0);
@@ -717,8 +973,7 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
         // A 'UART' request.
 
         uartCommand = reportIn[10];
-        debugPrint('|');
-        debugPrintHex(uartCommand);
+        logUartCommand(uartCommand);
 
         switch(uartCommand) {
         case 0x01: {
@@ -742,26 +997,26 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
         case 0x10: {
             // 'SPI' NVRAM read
             // ('SPI' because it's NVRAM connected by SPI in a real Pro Controller)
-            const uint16_t address = reportIn[11] | reportIn[12] << 8;
+            const uint32_t address = (uint16_t)(reportIn[11] | reportIn[12] << 8) | (uint32_t)reportIn[13] << 16 | (uint32_t)reportIn[14] << 24;
             const uint16_t length = reportIn[15];
 
-            debugPrint('<');
-            debugPrintHex16(address);
-            debugPrint(',');
-            debugPrintHex16(length);
+            logSpiAccess(LOG_SPI_READ, address, length);
 
             prepareUartSpiReplyReport_P(address, length);
         } break;
         case 0x11: {
             // 'SPI' NVRAM write
-            const uint16_t address = reportIn[11] | reportIn[12] << 8;
-            const uint16_t length = reportIn[15];
+            const uint32_t address = (uint16_t)(reportIn[11] | reportIn[12] << 8) | (uint32_t)reportIn[13] << 16 | (uint32_t)reportIn[14] << 24;
+            uint16_t length = reportIn[15];
             const uint8_t *buffer = &reportIn[16];
 
-            debugPrint('>');
-            debugPrintHex16(address);
-            debugPrint(',');
-            debugPrintHex16(length);
+            // Whatever the length says, don't read past the end of the report.
+            const uint8_t bufferLength = reportLength > 16 ? reportLength - 16 : 0;
+            if(length > bufferLength) {
+                length = bufferLength;
+            }
+
+            logSpiAccess(LOG_SPI_WRITE, address, length);
 
             spiMemoryWrite(address, buffer, length);
 
@@ -773,8 +1028,8 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
             break;
         case 0x48: // Set vibration enabled state
             sRumbleEnabled = reportIn[11];
-            debugPrintStr6(STR6(" Rumble")) ;
-            debugPrintStr6(sRumbleEnabled ? STR6(" enabled") : STR6(" disabled"));
+            rumbleEnvelopeReset();
+            logRumbleEnabled(sRumbleEnabled);
             prepareUartReplyReport_P(0x80, uartCommand, NULL, 0);
             break;
         case 0x21: {// Set NFC/IR MCU config
@@ -815,18 +1070,16 @@ static void usbFunctionWriteOutOrAbandon(uchar *data, uchar len, bool shouldAban
             decodeSwitchRumbleState(reportIn + 2, &leftRumbleState);
             decodeSwitchRumbleState(reportIn + 6, &rightRumbleState);
 
-            sLowRumbleAmplitude = highestByteFromNBytes(10, leftRumbleState.lowChannelAmplitude, rightRumbleState.lowChannelAmplitude,
-                                                        leftRumbleState.pulse1Amplitude, leftRumbleState.pulse2Amplitude, leftRumbleState.pulse3Amplitude, leftRumbleState.pulse1Amplitude,
-                                                        rightRumbleState.pulse1Amplitude, rightRumbleState.pulse2Amplitude, rightRumbleState.pulse3Amplitude, leftRumbleState.pulse1Amplitude);
-            sHighRumbleAmplitude = highestByteFromNBytes(10, leftRumbleState.highChannelAmplitude, rightRumbleState.highChannelAmplitude,
-                                                         leftRumbleState.pulse1Amplitude, leftRumbleState.pulse2Amplitude, leftRumbleState.pulse3Amplitude, leftRumbleState.pulse1Amplitude,
-                                                         rightRumbleState.pulse1Amplitude, rightRumbleState.pulse2Amplitude, rightRumbleState.pulse3Amplitude, leftRumbleState.pulse1Amplitude);
-
-            debugPrintStr6(STR6(" Rumble: ("));
-            debugPrintDec(sLowRumbleAmplitude);
-            debugPrint(',');
-            debugPrintDec(sHighRumbleAmplitude);
-            debugPrint(')');
+            uint8_t lowRumbleAmplitude;
+            uint8_t highRumbleAmplitude;
+            mixSwitchRumbleStates(&leftRumbleState, &rightRumbleState, &lowRumbleAmplitude, &highRumbleAmplitude);
+
+            // Rather than switching the motors straight to these amplitudes,
+            // let the envelope ramp them there in time for the next report.
+            rumbleEnvelopeSetTarget(lowRumbleAmplitude, highRumbleAmplitude, usbSofCount);
+            traceEvent(TRACE_RUMBLE_DECODE, lowRumbleAmplitude);
+
+            logRumbleAmplitudes(lowRumbleAmplitude, highRumbleAmplitude);
         }
     } break;
     case 0x00:
@@ -950,7 +1203,20 @@ static void ledHeartbeat()
         // doing.
         debugPrintStr6(STR6("] [OSC: "));
         debugPrintDec(OSCCAL);
+        // And the estimated current draw (see rumbleGovernor.h).
+        debugPrintStr6(STR6("] [MA: "));
+        debugPrintDec(rumbleGovernorEstimatedCurrent());
+        debugPrint('/');
+        debugPrintDec(rumbleGovernorPeakEstimatedCurrent());
         debugPrint(']');
+        rumbleGovernorResetPeak();
+        // And whether we've been printing more than the serial port can keep
+        // up with.
+        if(serialOverflowCount()) {
+            debugPrintStr6(STR6(" [SO: "));
+            debugPrintDec(serialOverflowCount());
+            debugPrint(']');
+        }
 
         transmittedReportsCount = 0;
 #endif
@@ -1007,11 +1273,16 @@ static void transmitPacket()
                 // state of the Dual Shock's controls - at the last minute
                 // in an attempt to get the lowest possible latency.
                 prepareInputSubReportInBuffer(transmittingReport + transmittingReportInputReportPosition);
+
+                // (The DualShock sample goes out in the packet we're about to
+                // hand to V-USB.)
+                latencyStatsHandedOff();
             }
 
             // Actually provide the packet to V-USB to be sent when the next
             // interrupt arrives.
             usbSetInterrupt(&transmittingReport[transmittingReportTransmissionCursor], packetSize);
+            traceEvent(TRACE_USB_SET_INTERRUPT, transmittingReportTransmissionCursor);
 
             transmittingReportTransmissionCursor = nextReportTransmissionCursor;
 
@@ -1062,10 +1333,35 @@ static void usbResume()
 }
 #endif
 
+#if IDLE_SLEEP_ON
+// Idles until the next interrupt. Everything the main loop does is prompted by
+// one - USB traffic on INT0 (including the 1ms SOFs), the Timer 0 overflow, or
+// the serial port - so there's no point spinning in between. Timers, the UART
+// and SPI all keep running in idle mode.
+static void idleUntilInterrupt(const uint8_t sofCountSeen)
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    // Check with interrupts off, so that a SOF or received USB message can't
+    // sneak in between checking and sleeping - we'd sleep through it until
+    // the next interrupt. `sei` always lets the following instruction run
+    // before any interrupt, so we're guaranteed to get to sleep before the
+    // interrupt wakes us. This is just a handful of cycles, well inside
+    // V-USB's 25 cycle limit.
+    cli();
+    if(usbSofCount == sofCountSeen && usbRxLen <= 0) {
+        sei();
+        sleep_cpu();
+    } else {
+        sei();
+    }
+}
+#endif
+
 void loop()
 {
     ledHeartbeat();
-    serialPoll();
+    consolePoll();
     usbPoll();
 
     const uint8_t sofCountNow = usbSofCount;
@@ -1077,6 +1373,7 @@ void loop()
     if(sofCountNow != lastSofCount) {
         lastSofCount = sofCountNow;
         lastSofTime = millisNow;
+        traceEvent(TRACE_SOF, sofCountNow);
         if(sUsbSuspended) {
             // We were suspended, but V-USB detected a SOF. Time to unsuspend.
             sUsbSuspended = false;
@@ -1093,10 +1390,16 @@ void loop()
         // (USB 2.0 spec: "7.1.7.6 Suspending")
         sUsbSuspended = true;
         debugPrintStr6(STR6("\nUSB Down\n"), true) ;
+        traceDump();
+        latencyStatsDump();
+        ackTimingDump();
     }
 
     if(!sUsbSuspended ) {
         if(usbInterruptIsReady()) {
+            // If we handed a packet to V-USB, the Switch has collected it.
+            latencyStatsDelivered();
+
             // Although V-USB is ready for us to give it the packet to transmit
             // on the next interrupt, we need less than 1ms to prepare, so we
             // can wait until the next 1ms SOF is received before preparing the
@@ -1112,13 +1415,26 @@ void loop()
                 transmitPacket();
             }
         }
+
+        // Commit any queued EEPROM writes, a byte at a time, in the gaps
+        // between the more time-sensitive work above.
+        pollEEPROM();
+
+#if IDLE_SLEEP_ON
+        idleUntilInterrupt(sofCountNow);
+#endif
     } else {
         // Clear any pending reports.
         sReportPending = false;
 
+        // Make sure nothing the Switch asked us to save is lost if the power
+        // goes while we sleep.
+        eepromLogFlush();
+
         // Switch off the debug LED to save power.
         PORTB |= (1 << 0);
 
+        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
         sleep_cpu();
 
         // USB traffic firing INT0 will wake us up.
@@ -1126,9 +1442,80 @@ void loop()
     }
 }
 
+#if BENCHMARK_ON
+// See benchmark.h. Doesn't return.
+static void runBenchmarks()
+{
+    benchmarkInit();
+    sei();
+
+    uint8_t buffer[sReportSize];
+
+    // Analog mode, with a few buttons pressed.
+    static const DualShockReport dualShockReport = { 0xff, { 0x73 }, 0x5a, { 0xf6 }, { 0xbf }, 0x20, 0x90, 0x70, 0xe0 };
+
+    // Everything but the exchange with the Dual Shock, which is mostly
+    // waiting for the bus (and, with nothing attached, for an ACK that never
+    // comes). With rumble on, as it is in most games.
+    sBenchmarkDualShockReply = &dualShockReport;
+    sRumbleEnabled = true;
+    BENCHMARK(BENCHMARK_PREPARE_INPUT_SUB_REPORT_IN_BUFFER, prepareInputSubReportInBuffer(buffer));
+    sRumbleEnabled = false;
+    sBenchmarkDualShockReply = NULL;
+
+    BENCHMARK(BENCHMARK_CONVERT_DUAL_SHOCK_TO_SWITCH, convertDualShockToSwitch(&dualShockReport, (SwitchReport *)buffer));
+
+    // The first call prepares an input report, and the rest send it, a
+    // packet at a time (then start another).
+    BENCHMARK(BENCHMARK_TRANSMIT_PACKET, transmitPacket());
+
+    // One of each encoding (see rumble.cpp) - they take different paths.
+    static const uint8_t singleWave[4] = { 0x28, 0x88, 0x60, 0x21 };       // X0: single wave with resonance.
+    static const uint8_t dualWave[4] = { 0x00, 0x01, 0x40, 0x40 };         // 0100: dual wave (the Switch's usual 'off').
+    static const uint8_t dualResonance3[4] = { 0x02, 0x12, 0x34, 0x56 };   // 0110: dual resonance with 3 pulses.
+    static const uint8_t dualResonance4[4] = { 0x9a, 0x7c, 0x5e, 0xd0 };   // 11: dual resonance with 4 pulses.
+    SwitchRumbleState rumbleState;
+    BENCHMARK(BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_SINGLE_WAVE, decodeSwitchRumbleState(singleWave, &rumbleState));
+    BENCHMARK(BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_WAVE, decodeSwitchRumbleState(dualWave, &rumbleState));
+    BENCHMARK(BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_RESONANCE_3, decodeSwitchRumbleState(dualResonance3, &rumbleState));
+    BENCHMARK(BENCHMARK_DECODE_SWITCH_RUMBLE_STATE_DUAL_RESONANCE_4, decodeSwitchRumbleState(dualResonance4, &rumbleState));
+
+    // Mixing the last two, as if from the left and right.
+    SwitchRumbleState leftRumbleState;
+    decodeSwitchRumbleState(dualResonance3, &leftRumbleState);
+    uint8_t lowRumbleAmplitude;
+    uint8_t highRumbleAmplitude;
+    BENCHMARK(BENCHMARK_MIX_SWITCH_RUMBLE_STATES, mixSwitchRumbleStates(&leftRumbleState, &rumbleState, &lowRumbleAmplitude, &highRumbleAmplitude));
+
+    // The stick calibration, then the user calibration - which the Switch
+    // reads when it connects.
+    BENCHMARK(BENCHMARK_SPI_MEMORY_READ_FLASH, spiMemoryRead(buffer, 0x603d, 0x19));
+    BENCHMARK(BENCHMARK_SPI_MEMORY_READ_EEPROM, spiMemoryRead(buffer, 0x8010, 0x18));
+
+    BENCHMARK(BENCHMARK_SERIAL_PRINT_STR6, serialPrintStr6(STR6("Benchmark\n")));
+
+    // Decoding one of our longer strings, without printing it - the old way,
+    // then the new (see packedStrings.h).
+    const uint8_t *str6 = STR6("Bad 'regular' subcommand");
+    BENCHMARK(BENCHMARK_STR6_CHAR_AT_INDEX,
+        for(uint8_t i = 0; (buffer[i] = str6CharAtIndex(str6, i)) != 0; ++i);
+    );
+    BENCHMARK(BENCHMARK_STR6_READ_CHAR,
+        PackedStringReader reader;
+        packedStringReaderInit(&reader, str6);
+        for(uint8_t i = 0; (buffer[i] = str6ReadChar(&reader)) != 0; ++i);
+    );
+
+    benchmarkFinish();
+}
+#endif
+
+// (The host build has its own - see lib/avr-host.)
+#ifndef AVR_HOST
 int main() {
     setup();
     do {
         loop();
     } while(true);
 }
+#endif
@@ -1,5 +1,23 @@
 #include "packedStrings.h"
 
+static uint8_t str6CharFromCode(const uint8_t code) {
+    uint8_t ch = 0x20 + code;
+    switch(ch) {
+    case '^':
+        ch = '\n';
+        break;
+    case '!':
+        ch = '|';
+        break;
+    case ';':
+        ch = '\0';
+        break;
+    default:
+        break;
+    }
+    return ch;
+}
+
 const uint8_t str7CharAtIndex(const uint8_t *data, const uint8_t index) {
     const size_t bitPosition = index * 7;
     const uint8_t startByte = bitPosition / 8;
@@ -19,19 +37,30 @@ const uint8_t str6CharAtIndex(const uint8_t *data, const uint8_t index) {
     if(startBit > (8-6)) {
         ch |= pgm_read_byte(&data[startByte + 1]) >> (8 - startBit);
     }
-    ch = 0x20 + (ch >> 2);
-    switch(ch) {
-    case '^':
-        ch = '\n';
-        break;
-    case '!':
-        ch = '|';
-        break;
-    case ';':
-        ch = '\0';
-        break;
-    default:
-        break;
+    return str6CharFromCode(ch >> 2);
+}
+
+void packedStringReaderInit(PackedStringReader *reader, const uint8_t *data) {
+    reader->data = data;
+    reader->bits = 0;
+    reader->bitCount = 0;
+}
+
+static uint8_t packedStringReadBits(PackedStringReader *reader, const uint8_t bitsPerChar) {
+    if(reader->bitCount < bitsPerChar) {
+        reader->bits |= (uint16_t)pgm_read_byte(reader->data++) << (8 - reader->bitCount);
+        reader->bitCount += 8;
     }
-    return ch;
-}
\ No newline at end of file
+    const uint8_t code = reader->bits >> (16 - bitsPerChar);
+    reader->bits <<= bitsPerChar;
+    reader->bitCount -= bitsPerChar;
+    return code;
+}
+
+const uint8_t str7ReadChar(PackedStringReader *reader) {
+    return packedStringReadBits(reader, 7);
+}
+
+const uint8_t str6ReadChar(PackedStringReader *reader) {
+    return str6CharFromCode(packedStringReadBits(reader, 6));
+}
@@ -11,6 +11,23 @@
 const uint8_t str7CharAtIndex(const uint8_t *data, const uint8_t index);
 const uint8_t str6CharAtIndex(const uint8_t *data, const uint8_t index);
 
+// For reading a packed string from start to end - which is almost always what
+// we want - these are cheaper than the 'AtIndex' functions above. They read
+// each byte of the string from PROGMEM only once, and shift the bits out of an
+// accumulator rather than working out where each character starts.
+struct PackedStringReader {
+    const uint8_t *data;    // The next byte to load.
+    uint16_t bits;          // Loaded bits not yet read, from the top down.
+    uint8_t bitCount;
+};
+
+void packedStringReaderInit(PackedStringReader *reader, const uint8_t *data);
+
+// These return '\0' at the end of the string (and must not be called again
+// after that).
+const uint8_t str7ReadChar(PackedStringReader *reader);
+const uint8_t str6ReadChar(PackedStringReader *reader);
+
 
 template <size_t bitsPerChar, size_t length>
 struct PackedStringConstexpr {
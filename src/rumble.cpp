@@ -87,7 +87,7 @@ struct __attribute__((packed)) RumbleStateX0SingleWaveWithResonance {
     uint8_t highChannelAmplitude4Bit:4;
 
     bool highLowSelect:1;
-    uint8_t frequency7Bit:4;
+    uint8_t frequency7Bit:7;
 };
 static_assert(sizeof(RumbleStateX0SingleWaveWithResonance) == 4, "RumbleStateX0SingleWaveWithResonance fields incorrect or incorrectly packed");
 
@@ -219,34 +219,19 @@ static uint8_t amplitudeFrom7BitAmplitude(uint8_t sevenBitValue)
 }
 
 #if RUMBLE_INCLUDE_FREQUENCY
-static uint16_t frequencyFrom7BitFrequency(uint8_t sevenBitValue)
+// Because of the way we flip the buffer before decoding it (see below), the
+// 7-bit frequency fields come out bit-reversed. The neutral '00 01 40 40'
+// state decodes to 1 in both - i.e. 0x40, which is 160Hz (low) and 320Hz
+// (high).
+static uint8_t lowFrequencyFrom7BitFrequency(const uint8_t sevenBitValue)
 {
-    static const PROGMEM uint16_t rumble_freq_lut[] = {
-        0x0029, 0x002a, 0x002b, 0x002c, 0x002d, 0x002e, 0x002f, 0x0030, 0x0031,
-        0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0039, 0x003a, 0x003b,
-        0x003c, 0x003e, 0x003f, 0x0040, 0x0042, 0x0043, 0x0045, 0x0046, 0x0048,
-        0x0049, 0x004b, 0x004d, 0x004e, 0x0050, 0x0052, 0x0054, 0x0055, 0x0057,
-        0x0059, 0x005b, 0x005d, 0x005f, 0x0061, 0x0063, 0x0066, 0x0068, 0x006a,
-        0x006c, 0x006f, 0x0071, 0x0074, 0x0076, 0x0079, 0x007b, 0x007e, 0x0081,
-        0x0084, 0x0087, 0x0089, 0x008d, 0x0090, 0x0093, 0x0096, 0x0099, 0x009d,
-        0x00a0, 0x00a4, 0x00a7, 0x00ab, 0x00ae, 0x00b2, 0x00b6, 0x00ba, 0x00be,
-        0x00c2, 0x00c7, 0x00cb, 0x00cf, 0x00d4, 0x00d9, 0x00dd, 0x00e2, 0x00e7,
-        0x00ec, 0x00f1, 0x00f7, 0x00fc, 0x0102, 0x0107, 0x010d, 0x0113, 0x0119,
-        0x011f, 0x0125, 0x012c, 0x0132, 0x0139, 0x0140, 0x0147, 0x014e, 0x0155,
-        0x015d, 0x0165, 0x016c, 0x0174, 0x017d, 0x0185, 0x018d, 0x0196, 0x019f,
-        0x01a8, 0x01b1, 0x01bb, 0x01c5, 0x01ce, 0x01d9, 0x01e3, 0x01ee, 0x01f8,
-        0x0203, 0x020f, 0x021a, 0x0226, 0x0232, 0x023e, 0x024b, 0x0258, 0x0265,
-        0x0272, 0x0280, 0x028e, 0x029c, 0x02ab, 0x02ba, 0x02c9, 0x02d9, 0x02e9,
-        0x02f9, 0x030a, 0x031b, 0x032c, 0x033e, 0x0350, 0x0363, 0x0376, 0x0389,
-        0x039d, 0x03b1, 0x03c6, 0x03db, 0x03f1, 0x0407, 0x041d, 0x0434, 0x044c,
-        0x0464, 0x047d, 0x0496, 0x04af, 0x04ca, 0x04e5
-    };
+    return reverseBits(sevenBitValue) >> 1;
+}
 
-    if(sevenBitValue < sizeof(rumble_freq_lut)) {
-        return pgm_read_byte(&rumble_freq_lut[sevenBitValue]);
-    } else {
-        return pgm_read_byte(&rumble_freq_lut[sizeof(rumble_freq_lut) - 1]);
-    }
+static uint8_t highFrequencyFrom7BitFrequency(const uint8_t sevenBitValue)
+{
+    // High channel frequencies are encoded an octave up.
+    return (reverseBits(sevenBitValue) >> 1) + 32;
 }
 #endif
 
@@ -273,12 +258,16 @@ void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleStat
         const RumbleStateX0SingleWaveWithResonance *packedRumbleState = (RumbleStateX0SingleWaveWithResonance *)&rumbleStateFlipped;
 
 #if RUMBLE_INCLUDE_FREQUENCY
+        // The 7-bit amplitude (which we call 'pulse 2') is for the single wave
+        // at the encoded frequency.
         if(packedRumbleState->highLowSelect == 1) {
-            switchRumbleStateOut->lowChannelFrequency = 160;
-            switchRumbleStateOut->highChannelFrequency = frequencyFrom7BitFrequency(packedRumbleState->frequency7Bit);
+            switchRumbleStateOut->lowChannelFrequency = RUMBLE_FREQUENCY_160HZ;
+            switchRumbleStateOut->highChannelFrequency = highFrequencyFrom7BitFrequency(packedRumbleState->frequency7Bit);
+            switchRumbleStateOut->pulseFrequency = switchRumbleStateOut->highChannelFrequency;
         } else {
-            switchRumbleStateOut->lowChannelFrequency = frequencyFrom7BitFrequency(packedRumbleState->frequency7Bit);
-            switchRumbleStateOut->highChannelFrequency = 320;
+            switchRumbleStateOut->lowChannelFrequency = lowFrequencyFrom7BitFrequency(packedRumbleState->frequency7Bit);
+            switchRumbleStateOut->highChannelFrequency = RUMBLE_FREQUENCY_320HZ;
+            switchRumbleStateOut->pulseFrequency = switchRumbleStateOut->lowChannelFrequency;
         }
 #endif
         if(!packedRumbleState->highChannelSwitch) {
@@ -301,27 +290,32 @@ void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleStat
         const RumbleState0100DualWave *packedRumbleState = (RumbleState0100DualWave *)&rumbleStateFlipped;
 
 #if RUMBLE_INCLUDE_FREQUENCY
-        switchRumbleStateOut->highChannelFrequency = frequencyFrom7BitFrequency(packedRumbleState->highChannelFrequency7Bit);
+        switchRumbleStateOut->highChannelFrequency = highFrequencyFrom7BitFrequency(packedRumbleState->highChannelFrequency7Bit);
 #endif
         switchRumbleStateOut->highChannelAmplitude = amplitudeFrom7BitAmplitude(packedRumbleState->highChannelAmplitude7Bit);
 
 #if RUMBLE_INCLUDE_FREQUENCY
-        switchRumbleStateOut->lowChannelFrequency = frequencyFrom7BitFrequency(packedRumbleState->lowChannelFrequency7Bit);
+        switchRumbleStateOut->lowChannelFrequency = lowFrequencyFrom7BitFrequency(packedRumbleState->lowChannelFrequency7Bit);
 #endif
         switchRumbleStateOut->lowChannelAmplitude = amplitudeFrom7BitAmplitude(packedRumbleState->lowChannelAmplitude7Bit);
     } break;
     case RumbleStateType0110DualResonanceWith3Pulse: {
         const RumbleState0110DualResonanceWith3Pulse *packedRumbleState = (RumbleState0110DualResonanceWith3Pulse *)&rumbleStateFlipped;
 
+#if RUMBLE_INCLUDE_FREQUENCY
+        // The pulses ride on both resonances, so we place them between them.
+        switchRumbleStateOut->pulseFrequency = RUMBLE_FREQUENCY_226HZ;
+#endif
+
         if(!packedRumbleState->highChannelSwitch) {
 #if RUMBLE_INCLUDE_FREQUENCY
-            switchRumbleStateOut->highChannelFrequency = 320;
+            switchRumbleStateOut->highChannelFrequency = RUMBLE_FREQUENCY_320HZ;
 #endif
             switchRumbleStateOut->highChannelAmplitude = amplitudeFrom4BitAmplitude(packedRumbleState->highChannelAmplitude4Bit);
         }
         if(!packedRumbleState->lowChannelSwitch) {
 #if RUMBLE_INCLUDE_FREQUENCY
-            switchRumbleStateOut->lowChannelFrequency = 160;
+            switchRumbleStateOut->lowChannelFrequency = RUMBLE_FREQUENCY_160HZ;
 #endif
             switchRumbleStateOut->lowChannelAmplitude = amplitudeFrom4BitAmplitude(packedRumbleState->lowChannelAmplitude4Bit);
         }
@@ -336,9 +330,13 @@ void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleStat
     case RumbleStateType11DualResonanceWith4Pulse: {
         const RumbleState11DualResonanceWith4Pulse *packedRumbleState = (RumbleState11DualResonanceWith4Pulse *)&rumbleStateFlipped;
 
+#if RUMBLE_INCLUDE_FREQUENCY
+        switchRumbleStateOut->pulseFrequency = RUMBLE_FREQUENCY_226HZ;
+#endif
+
         if(!packedRumbleState->highChannelSwitch) {
 #if RUMBLE_INCLUDE_FREQUENCY
-            switchRumbleStateOut->highChannelFrequency = 320;
+            switchRumbleStateOut->highChannelFrequency = RUMBLE_FREQUENCY_320HZ;
 #endif
             switchRumbleStateOut->highChannelAmplitude = amplitudeFrom4BitAmplitude(packedRumbleState->highChannelAmplitude4Bit);
             if(!packedRumbleState->pulse1Or400HzSwitch) {
@@ -347,22 +345,22 @@ void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleStat
         } else {
             if(!packedRumbleState->pulse1Or400HzSwitch) {
 #if RUMBLE_INCLUDE_FREQUENCY
-                switchRumbleStateOut->highChannelFrequency = 400;
+                switchRumbleStateOut->highChannelFrequency = RUMBLE_FREQUENCY_400HZ;
 #endif
                 switchRumbleStateOut->highChannelAmplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse1Or400HzAmplitude4Bit);
             }
         }
         if(!packedRumbleState->lowChannelSwitch) {
 #if RUMBLE_INCLUDE_FREQUENCY
-            switchRumbleStateOut->lowChannelFrequency = 160;
+            switchRumbleStateOut->lowChannelFrequency = RUMBLE_FREQUENCY_160HZ;
 #endif
             switchRumbleStateOut->lowChannelAmplitude = amplitudeFrom4BitAmplitude(packedRumbleState->lowChannelAmplitude4Bit);
         }
         if(!packedRumbleState->pulse2Switch) {
-            switchRumbleStateOut->pulse3Amplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse4Amplitude4Bit);
+            switchRumbleStateOut->pulse2Amplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse2Amplitude4Bit);
         }
         if(!packedRumbleState->pulse3Switch) {
-            switchRumbleStateOut->pulse3Amplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse4Amplitude4Bit);
+            switchRumbleStateOut->pulse3Amplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse3Amplitude4Bit);
         }
         if(!packedRumbleState->pulse4Switch) {
             switchRumbleStateOut->pulse4Amplitude = amplitudeFrom4BitAmplitude(packedRumbleState->pulse4Amplitude4Bit);
@@ -371,4 +369,59 @@ void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleStat
     default:
         break;
     }
-}
\ No newline at end of file
+}
+
+// Components at or below 160Hz go entirely to the big motor, and those at or
+// above 320Hz entirely to the small one. In between, they're crossfaded.
+// Conveniently, 160Hz to 320Hz is 32 steps in our frequency scale.
+static void mixComponent(const uint8_t amplitude, const uint8_t frequency, uint8_t *lowAmplitude, uint8_t *highAmplitude)
+{
+    uint8_t lowWeight;
+    if(frequency <= RUMBLE_FREQUENCY_160HZ) {
+        lowWeight = 32;
+    } else if(frequency >= RUMBLE_FREQUENCY_320HZ) {
+        lowWeight = 0;
+    } else {
+        lowWeight = RUMBLE_FREQUENCY_320HZ - frequency;
+    }
+
+    const uint8_t lowPart = ((uint16_t)amplitude * lowWeight) >> 5;
+    const uint8_t highPart = ((uint16_t)amplitude * (uint8_t)(32 - lowWeight)) >> 5;
+    if(lowPart > *lowAmplitude) {
+        *lowAmplitude = lowPart;
+    }
+    if(highPart > *highAmplitude) {
+        *highAmplitude = highPart;
+    }
+}
+
+static void mixSwitchRumbleState(const SwitchRumbleState *rumbleState, uint8_t *lowAmplitude, uint8_t *highAmplitude)
+{
+#if RUMBLE_INCLUDE_FREQUENCY
+    const uint8_t lowChannelFrequency = rumbleState->lowChannelFrequency;
+    const uint8_t highChannelFrequency = rumbleState->highChannelFrequency;
+    const uint8_t pulseFrequency = rumbleState->pulseFrequency;
+#else
+    const uint8_t lowChannelFrequency = RUMBLE_FREQUENCY_160HZ;
+    const uint8_t highChannelFrequency = RUMBLE_FREQUENCY_320HZ;
+    const uint8_t pulseFrequency = RUMBLE_FREQUENCY_226HZ;
+#endif
+
+    mixComponent(rumbleState->lowChannelAmplitude, lowChannelFrequency, lowAmplitude, highAmplitude);
+    mixComponent(rumbleState->highChannelAmplitude, highChannelFrequency, lowAmplitude, highAmplitude);
+    mixComponent(rumbleState->pulse1Amplitude, pulseFrequency, lowAmplitude, highAmplitude);
+    mixComponent(rumbleState->pulse2Amplitude, pulseFrequency, lowAmplitude, highAmplitude);
+    mixComponent(rumbleState->pulse3Amplitude, pulseFrequency, lowAmplitude, highAmplitude);
+    mixComponent(rumbleState->pulse4Amplitude, pulseFrequency, lowAmplitude, highAmplitude);
+}
+
+void mixSwitchRumbleStates(const SwitchRumbleState *leftRumbleState, const SwitchRumbleState *rightRumbleState,
+                           uint8_t *lowAmplitudeOut, uint8_t *highAmplitudeOut)
+{
+    // The Dual Shock has only one of each motor, so we take the strongest
+    // contribution to each from either side.
+    *lowAmplitudeOut = 0;
+    *highAmplitudeOut = 0;
+    mixSwitchRumbleState(leftRumbleState, lowAmplitudeOut, highAmplitudeOut);
+    mixSwitchRumbleState(rightRumbleState, lowAmplitudeOut, highAmplitudeOut);
+}
@@ -3,12 +3,29 @@
 
 #include <stdint.h>
 
+// Set this to 1 to decode each channel's and pulse's frequency too, so the
+// mixer (below) can split them between the motors by frequency. It's off by
+// default until its flash and RAM cost on the ATmega8 has been measured -
+// without it, the mixer treats the low channel as 160Hz, the high channel as
+// 320Hz and the pulses as in between.
+#ifndef RUMBLE_INCLUDE_FREQUENCY
 #define RUMBLE_INCLUDE_FREQUENCY 0
+#endif
+
+// Frequencies are stored in a compact logarithmic form rather than in Hz.
+// Each step is 1/32 of an octave, and 64 is 160Hz - this is the scale the
+// Switch itself encodes frequencies in, so decoding needs no lookup table.
+// Hz = 160 * 2^((frequency - 64) / 32).
+#define RUMBLE_FREQUENCY_160HZ 64
+#define RUMBLE_FREQUENCY_226HZ 80
+#define RUMBLE_FREQUENCY_320HZ 96
+#define RUMBLE_FREQUENCY_400HZ 106
 
 struct SwitchRumbleState {
 #if RUMBLE_INCLUDE_FREQUENCY
-    uint16_t lowChannelFrequency;
-    uint16_t highChannelFrequency;
+    uint8_t lowChannelFrequency;
+    uint8_t highChannelFrequency;
+    uint8_t pulseFrequency;
 #endif
     uint8_t lowChannelAmplitude;
     uint8_t highChannelAmplitude;
@@ -20,4 +37,10 @@ struct SwitchRumbleState {
 
 void decodeSwitchRumbleState(const uint8_t *encodedRumbleState, SwitchRumbleState *switchRumbleStateOut);
 
+// Mixes the left and right rumble states down to amplitudes for the Dual
+// Shock's two motors: the big, low-frequency one, and the small,
+// high-frequency one.
+void mixSwitchRumbleStates(const SwitchRumbleState *leftRumbleState, const SwitchRumbleState *rightRumbleState,
+                           uint8_t *lowAmplitudeOut, uint8_t *highAmplitudeOut);
+
 #endif // __rumble_h_included__
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "rumbleEnvelope.h"
+
+#include <string.h>
+
+// The longest and shortest we'll take to ramp between two amplitudes, in ms.
+// The Switch usually sends rumble reports every ~8-15ms. If it goes quiet for
+// longer than the maximum, we just hold the last level it asked for.
+static const uint8_t sMinimumRampInterval = 2;
+static const uint8_t sMaximumRampInterval = 32;
+
+// Maximum change in amplitude per millisecond, in 8.8 fixed point.
+// Spinning up is limited less than spinning down, so that sharp hits still
+// feel sharp - the motors' inertia smooths the decay anyway.
+static const int16_t sAttackLimit = 64 << 8;
+static const int16_t sDecayLimit = 32 << 8;
+
+struct RumbleEnvelopeChannel {
+    uint16_t level;         // 8.8 fixed point.
+    int16_t stepPerMilli;   // 8.8 fixed point.
+    uint8_t target;
+};
+
+static RumbleEnvelopeChannel sChannels[2];
+static uint8_t sLastTargetTimestamp = 0;
+static uint8_t sLastStepTimestamp = 0;
+static uint8_t sRampInterval = 8;
+
+void rumbleEnvelopeReset()
+{
+    memset(sChannels, 0, sizeof(sChannels));
+}
+
+static void setChannelTarget(RumbleEnvelopeChannel *channel, const uint8_t target)
+{
+    channel->target = target;
+
+    // Ramp from wherever we are now - which might be part way through the
+    // previous ramp if reports are arriving bunched together - so the motor
+    // never jumps.
+    const int16_t delta = (int16_t)target - (int16_t)(channel->level >> 8);
+    if(delta == 0) {
+        channel->level = (uint16_t)target << 8;
+        channel->stepPerMilli = 0;
+        return;
+    }
+
+    // 256 / sRampInterval is at most 128, so this fits in 16 bits.
+    int16_t step = delta * (int16_t)(uint8_t)(256 / sRampInterval);
+    if(step > sAttackLimit) {
+        step = sAttackLimit;
+    } else if(step < -sDecayLimit) {
+        step = -sDecayLimit;
+    }
+    channel->stepPerMilli = step;
+}
+
+void rumbleEnvelopeSetTarget(const uint8_t lowAmplitude, const uint8_t highAmplitude, const uint8_t timestamp)
+{
+    // Keep a running average of the time between reports. Bunched reports
+    // (more than one in the same ms) don't tell us anything, so skip them.
+    const uint8_t sinceLastTarget = timestamp - sLastTargetTimestamp;
+    sLastTargetTimestamp = timestamp;
+    if(sinceLastTarget != 0) {
+        uint8_t measured = sinceLastTarget;
+        if(measured > sMaximumRampInterval) {
+            measured = sMaximumRampInterval;
+        }
+        sRampInterval = (uint8_t)(((uint16_t)sRampInterval * 3 + measured) / 4);
+        if(sRampInterval < sMinimumRampInterval) {
+            sRampInterval = sMinimumRampInterval;
+        }
+    }
+
+    setChannelTarget(&sChannels[0], lowAmplitude);
+    setChannelTarget(&sChannels[1], highAmplitude);
+}
+
+static uint8_t stepChannel(RumbleEnvelopeChannel *channel, const uint8_t elapsed)
+{
+    const uint16_t target = (uint16_t)channel->target << 8;
+    if(channel->level != target) {
+        const int32_t level = (int32_t)channel->level + (int32_t)channel->stepPerMilli * elapsed;
+
+        // Stop when we reach the target rather than overshooting.
+        if(channel->stepPerMilli > 0 ? level >= (int32_t)target : level <= (int32_t)target) {
+            channel->level = target;
+        } else {
+            channel->level = (uint16_t)level;
+        }
+    }
+    return (uint8_t)((channel->level + 0x80) >> 8);
+}
+
+void rumbleEnvelopeStep(const uint8_t timestamp, uint8_t *lowAmplitudeOut, uint8_t *highAmplitudeOut)
+{
+    const uint8_t elapsed = timestamp - sLastStepTimestamp;
+    sLastStepTimestamp = timestamp;
+
+    *lowAmplitudeOut = stepChannel(&sChannels[0], elapsed);
+    *highAmplitudeOut = stepChannel(&sChannels[1], elapsed);
+}
@@ -0,0 +1,26 @@
+#ifndef __rumbleenvelope_h_included__
+#define __rumbleenvelope_h_included__
+
+#include <stdint.h>
+
+// Smooths the motor amplitudes decoded from the Switch's rumble reports.
+//
+// The Switch only tells us about new amplitudes every few milliseconds, and
+// the reports are often delayed or bunched together by USB scheduling.
+// Rather than jumping straight to each new amplitude, we ramp linearly towards
+// it over the interval we've been seeing between reports, so that the motors
+// are at the requested level at about the time the next report is expected.
+// The slope of the ramps is limited so that the motors are never asked to spin
+// up or down faster than they usefully can.
+//
+// Timestamps are in milliseconds (the USB SOF count is a convenient source).
+
+void rumbleEnvelopeReset();
+
+// Call when a rumble report has been decoded.
+void rumbleEnvelopeSetTarget(const uint8_t lowAmplitude, const uint8_t highAmplitude, const uint8_t timestamp);
+
+// Call before commanding the motors to get the amplitudes to use now.
+void rumbleEnvelopeStep(const uint8_t timestamp, uint8_t *lowAmplitudeOut, uint8_t *highAmplitudeOut);
+
+#endif // __rumbleenvelope_h_included__
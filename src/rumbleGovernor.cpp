@@ -0,0 +1,90 @@
+#include "rumbleGovernor.h"
+
+#include <usbconfig.h>
+
+// All currents in mA.
+//
+// The adapter itself, with the Dual Shock attached and the LEDs on, measured
+// at up to 29mA (see Power.txt).
+static const uint8_t sAdapterCurrent = 30;
+
+// Rough estimates for the Dual Shock's motors running from USB power. The big
+// motor's current scales with the amplitude we command (the controller PWMs
+// it). The small one is either on or off - we PWM it ourselves.
+static const uint8_t sBigMotorFullCurrent = 60;
+static const uint8_t sSmallMotorCurrent = 40;
+
+static const uint8_t sMotorBudget = USB_CFG_MAX_BUS_POWER - sAdapterCurrent;
+
+// The big motor doesn't turn at all below about this amplitude, so there's no
+// point capping it lower than this - we stop it instead.
+static const uint8_t sBigMotorMinimumAmplitude = 0x40;
+
+static uint16_t sSmoothedCurrent = (uint16_t)sAdapterCurrent << 4;   // 12.4 fixed point.
+static uint8_t sPeakCurrent = sAdapterCurrent;
+static bool sSmallMotorHasPriority = false;
+
+static uint8_t bigMotorCurrent(const uint8_t amplitude)
+{
+    return ((uint16_t)amplitude * sBigMotorFullCurrent) >> 8;
+}
+
+static uint8_t bigMotorAmplitudeForCurrent(const uint8_t current)
+{
+    if(current >= sBigMotorFullCurrent) {
+        return 0xff;
+    }
+    return ((uint16_t)current << 8) / sBigMotorFullCurrent;
+}
+
+void rumbleGovernorApply(uint8_t *bigMotorAmplitude, bool *smallMotorOn)
+{
+    uint8_t smallCurrent = *smallMotorOn ? sSmallMotorCurrent : 0;
+
+    if(bigMotorCurrent(*bigMotorAmplitude) + smallCurrent > sMotorBudget) {
+        if(smallCurrent) {
+            // Both motors want more than we have. Take turns: the motor with
+            // priority this poll runs as requested, and the other gets what's
+            // left.
+            if(sSmallMotorHasPriority) {
+                const uint8_t bigAmplitudeCap = bigMotorAmplitudeForCurrent(sMotorBudget - smallCurrent);
+                if(*bigMotorAmplitude > bigAmplitudeCap) {
+                    *bigMotorAmplitude = bigAmplitudeCap >= sBigMotorMinimumAmplitude ? bigAmplitudeCap : 0;
+                }
+            } else {
+                *smallMotorOn = false;
+                smallCurrent = 0;
+            }
+            sSmallMotorHasPriority = !sSmallMotorHasPriority;
+        }
+
+        // The big motor might be too much on its own.
+        const uint8_t bigAmplitudeCap = bigMotorAmplitudeForCurrent(sMotorBudget - smallCurrent);
+        if(*bigMotorAmplitude > bigAmplitudeCap) {
+            *bigMotorAmplitude = bigAmplitudeCap;
+        }
+    }
+
+    const uint8_t current = sAdapterCurrent + bigMotorCurrent(*bigMotorAmplitude) + smallCurrent;
+    if(current > sPeakCurrent) {
+        sPeakCurrent = current;
+    }
+
+    // Exponential moving average, weighting this poll at 1/16.
+    sSmoothedCurrent = sSmoothedCurrent - (sSmoothedCurrent >> 4) + current;
+}
+
+uint8_t rumbleGovernorEstimatedCurrent()
+{
+    return sSmoothedCurrent >> 4;
+}
+
+uint8_t rumbleGovernorPeakEstimatedCurrent()
+{
+    return sPeakCurrent;
+}
+
+void rumbleGovernorResetPeak()
+{
+    sPeakCurrent = sAdapterCurrent;
+}
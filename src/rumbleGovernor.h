@@ -0,0 +1,24 @@
+#ifndef __rumblegovernor_h_included__
+#define __rumblegovernor_h_included__
+
+#include <stdint.h>
+
+// Keeps the Dual Shock's motors within the USB power budget we declare in our
+// configuration descriptor (USB_CFG_MAX_BUS_POWER).
+//
+// Motor current comes on top of what the adapter itself draws (see Power.txt)
+// and, if the host's supply sags, a long burst of rumble could take the
+// ATmega below its brown-out level. We estimate the current the motors will
+// draw from the amplitudes we're about to command, and, if it's too much,
+// time-slice the two motors (giving each priority on alternate polls) and cap
+// the big motor's amplitude.
+
+// Call with the motor commands we're about to send - they're adjusted in place.
+void rumbleGovernorApply(uint8_t *bigMotorAmplitude, bool *smallMotorOn);
+
+// Telemetry, all in mA and including the adapter's own draw.
+uint8_t rumbleGovernorEstimatedCurrent();       // Smoothed over recent polls.
+uint8_t rumbleGovernorPeakEstimatedCurrent();   // Highest since last reset.
+void rumbleGovernorResetPeak();
+
+#endif // __rumblegovernor_h_included__
@@ -1,14 +1,22 @@
 #include <serial.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <stdlib.h>
 #include <packedStrings.h>
 
-// A simple circular buffer to store serial output.
+// A simple circular buffer to store serial output. It's emptied by the
+// transmit complete interrupt below.
 static const uint8_t sSerialOutputBufferLength = 128;
 static uint8_t sSerialOutputBuffer[sSerialOutputBufferLength];
-static uint8_t sSerialOutputBufferStart = 0;
-static uint8_t sSerialOutputBufferEnd = 0;
+static volatile uint8_t sSerialOutputBufferStart = 0;
+static volatile uint8_t sSerialOutputBufferEnd = 0;
 
+// True while the UART is sending a character from the buffer - i.e. while a
+// transmit complete interrupt is on its way.
+static volatile bool sSerialTransmitting = false;
+
+static volatile uint8_t sSerialOverflowCount = 0;
 
 void serialInit(const uint32_t baudRate)
 {
@@ -18,33 +26,227 @@ void serialInit(const uint32_t baudRate)
     UBRRH = (uint8_t)(ubrr >> 8);
     UBRRL = (uint8_t)ubrr;
 
-    UCSRB = (1 << TXEN);
+    UCSRB = (1 << TXEN) | (1 << TXCIE)
+#if SERIAL_CONSOLE_ON
+        | (1 << RXEN) | (1 << RXCIE)
+#endif
+    ;
     UCSRC = (1 << URSEL) | (1 << UCSZ1) | (1 << UCSZ0);
 #else
     UBRR0H = (uint8_t)(ubrr >> 8);
     UBRR0L = (uint8_t)ubrr;
 
-    UCSR0B = (1 << TXEN0);
+    UCSR0B = (1 << TXEN0) | (1 << TXCIE0)
+#if SERIAL_CONSOLE_ON
+        | (1 << RXEN0) | (1 << RXCIE0)
+#endif
+    ;
     UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
 #endif
 }
 
+// Sends the character at the start of the buffer, which mustn't be empty.
+// Only for whoever has claimed the UART by setting `sSerialTransmitting` -
+// then nothing else takes characters from the buffer until the transmit
+// complete interrupt, so this needn't disable interrupts (except to cope with
+// SERIAL_OVERFLOW_DROPS_OLDEST).
+static void serialSendNext()
+{
+    // Move the start on before sending, so the transmit complete interrupt
+    // can never find the character still there.
+    const uint8_t start = sSerialOutputBufferStart;
+    const uint8_t next = sSerialOutputBuffer[start];
+#if SERIAL_OVERFLOW_DROPS_OLDEST
+    // A print that drops the oldest character moves the start on too. If
+    // one's done that since we read it, the character's gone already - but
+    // it's simplest to send it anyway. (About 9 cycles with interrupts off.)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if(sSerialOutputBufferStart == start) {
+            sSerialOutputBufferStart = (uint8_t)(start + 1) % sSerialOutputBufferLength;
+        }
+    }
+#else
+    sSerialOutputBufferStart = (uint8_t)(start + 1) % sSerialOutputBufferLength;
+#endif
+#ifdef __AVR_ATmega8__
+    UDR = next;
+#else
+    UDR0 = next;
+#endif
+}
+
+// For whoever has the UART, once it's finished sending a character: sends the
+// next, or gives the UART up if there isn't one.
+static void serialTransmitNext()
+{
+    // Giving up the UART must happen along with finding the buffer empty, or
+    // a character printed in between would never be sent. Around 9 cycles
+    // from `cli` to restoring SREG.
+    bool empty;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        empty = sSerialOutputBufferStart == sSerialOutputBufferEnd;
+        if(empty) {
+            sSerialTransmitting = false;
+        }
+    }
+    if(!empty) {
+        serialSendNext();
+    }
+}
+
+// We use the transmit complete interrupt rather than the more usual data
+// register empty one because its flag is cleared when the interrupt runs, so
+// the handler can be ISR_NOBLOCK (as everything must be, so as not to hold up
+// V-USB's interrupt) without immediately interrupting itself. The cost is a
+// gap of a few microseconds between characters.
+#ifdef __AVR_ATmega8__
+ISR(USART_TXC_vect, ISR_NOBLOCK)
+#else
+ISR(USART_TX_vect, ISR_NOBLOCK)
+#endif
+{
+    serialTransmitNext();
+}
+
 void serialPoll()
 {
-    if(sSerialOutputBufferStart != sSerialOutputBufferEnd) {
+    // Normally the interrupt does all the work - but if interrupts are
+    // disabled (e.g. while halting), we have to do it ourselves.
+    if(!(SREG & (1 << SREG_I)) && sSerialTransmitting) {
 #ifdef __AVR_ATmega8__
-        if(UCSRA & (1 << UDRE)) {
-            UDR =
+        if(UCSRA & (1 << TXC)) {
+            UCSRA = (UCSRA & ((1 << U2X) | (1 << MPCM))) | (1 << TXC);
 #else
-        if(UCSR0A & (1 << UDRE0)) {
-            UDR0 =
+        if(UCSR0A & (1 << TXC0)) {
+            UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
 #endif
-                sSerialOutputBuffer[sSerialOutputBufferStart];
-            sSerialOutputBufferStart = (uint8_t)(sSerialOutputBufferStart + 1) % sSerialOutputBufferLength;
+            serialTransmitNext();
         }
     }
 }
 
+void serialFlush()
+{
+    // The UART's only given up once its transmit complete interrupt finds
+    // nothing left to send - and the main loop can't see that until the
+    // handler has returned.
+    while(sSerialTransmitting) {
+        serialPoll();
+    }
+}
+
+#if SERIAL_CONSOLE_ON
+// A circular buffer for received characters, filled by the receive complete
+// interrupt below. Full is indistinguishable from empty, so if more than
+// 15 characters are waiting, they're lost - but the console is for typing at.
+static const uint8_t sSerialInputBufferLength = 16;
+static volatile uint8_t sSerialInputBuffer[sSerialInputBufferLength];
+static uint8_t sSerialInputBufferStart = 0;
+static volatile uint8_t sSerialInputBufferEnd = 0;
+
+// The receive complete interrupt flag is only cleared by reading the data
+// register, so an ISR_NOBLOCK handler would interrupt itself before it got the
+// chance. Instead, this reads the data register as soon as it can, then
+// re-enables interrupts. The receiver has a two character FIFO, and two
+// characters can be waiting if V-USB's interrupt held us up (it can take
+// longer than a character at 266667 baud), so it reads the second one too
+// before re-enabling interrupts - otherwise the flag would still be set, and
+// the second character would interrupt us and be stored before the first.
+// Worst case, from the interrupt firing to the end of the instruction after
+// `sei`: 4 cycles to respond, 2 or 3 for the vector's jump, then
+// 2+2+2+2+2+2+1+2 - 22 in all, inside V-USB's 25 cycle limit. Only then does
+// it save what it needs to store the characters in the buffer.
+// (Only a third character arriving in the few cycles before we read
+// sSerialInputBufferEnd could still get ahead - but the console is for
+// typing at.)
+#ifdef __AVR_ATmega8__
+ISR(USART_RXC_vect, ISR_NAKED)
+#else
+ISR(USART_RX_vect, ISR_NAKED)
+#endif
+{
+    asm volatile(
+        "push r24\n\t"
+        "lds r24, %[udr]\n\t"
+        "push r25\n\t"
+        "lds r25, %[ucsra]\n\t"
+        "sbrs r25, %[rxc]\n\t"
+        "rjmp 1f\n\t"
+        "lds r25, %[udr]\n\t"
+        "sei\n\t"
+        "push r23\n\t"
+        "ldi r23, 2\n\t"
+        "rjmp 2f\n\t"
+    "1:\n\t"
+        "sei\n\t"
+        "push r23\n\t"
+        "ldi r23, 1\n\t"
+    "2:\n\t"
+        "push r22\n\t"
+        "in r22, __SREG__\n\t"
+        "push r22\n\t"
+        "push r30\n\t"
+        "push r31\n\t"
+
+        // For r23 characters (r24, then r25):
+        //     sSerialInputBuffer[sSerialInputBufferEnd] = r24;
+        //     sSerialInputBufferEnd = (sSerialInputBufferEnd + 1) % sSerialInputBufferLength;
+        "lds r22, %[end]\n\t"
+    "3:\n\t"
+        "mov r30, r22\n\t"
+        "ldi r31, 0\n\t"
+        "subi r30, lo8(-(%[buffer]))\n\t"
+        "sbci r31, hi8(-(%[buffer]))\n\t"
+        "st Z, r24\n\t"
+        "inc r22\n\t"
+        "andi r22, %[mask]\n\t"
+        "mov r24, r25\n\t"
+        "dec r23\n\t"
+        "brne 3b\n\t"
+        "sts %[end], r22\n\t"
+
+        "pop r31\n\t"
+        "pop r30\n\t"
+        "pop r22\n\t"
+        "out __SREG__, r22\n\t"
+        "pop r22\n\t"
+        "pop r23\n\t"
+        "pop r25\n\t"
+        "pop r24\n\t"
+        "reti\n\t"
+        :
+#ifdef __AVR_ATmega8__
+        : [udr] "n" (_SFR_MEM_ADDR(UDR)),
+          [ucsra] "n" (_SFR_MEM_ADDR(UCSRA)),
+          [rxc] "I" (RXC),
+#else
+        : [udr] "n" (_SFR_MEM_ADDR(UDR0)),
+          [ucsra] "n" (_SFR_MEM_ADDR(UCSR0A)),
+          [rxc] "I" (RXC0),
+#endif
+          [end] "i" (&sSerialInputBufferEnd),
+          [buffer] "i" (sSerialInputBuffer),
+          [mask] "M" (sSerialInputBufferLength - 1)
+    );
+}
+static_assert((sSerialInputBufferLength & (sSerialInputBufferLength - 1)) == 0, "Input buffer length must be a power of two");
+
+bool serialRead(uint8_t *ch)
+{
+    if(sSerialInputBufferStart == sSerialInputBufferEnd) {
+        return false;
+    }
+    *ch = sSerialInputBuffer[sSerialInputBufferStart];
+    sSerialInputBufferStart = (uint8_t)(sSerialInputBufferStart + 1) % sSerialInputBufferLength;
+    return true;
+}
+#endif
+
+uint8_t serialOverflowCount()
+{
+    return sSerialOverflowCount;
+}
+
 void serialPrint(const uint8_t ch, const bool wait)
 {
     if(wait) {
@@ -52,8 +254,69 @@ void serialPrint(const uint8_t ch, const bool wait)
             serialPoll();
         }
     }
-    sSerialOutputBuffer[sSerialOutputBufferEnd] = ch;
-    sSerialOutputBufferEnd = (uint8_t)(sSerialOutputBufferEnd + 1) % sSerialOutputBufferLength;
+
+    // This may be called from interrupt handlers as well as the main loop, so
+    // nothing must come between checking for space and claiming it. V-USB's
+    // interrupt can't be held up by more than 25 cycles, so only that is done
+    // with interrupts disabled: around 17 cycles from `cli` to restoring SREG
+    // - 21 when dropping the oldest character - and the UART is started
+    // below, after claiming it in another 12 or so.
+    bool full;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        const uint8_t end = sSerialOutputBufferEnd;
+        const uint8_t nextEnd = (uint8_t)(end + 1) % sSerialOutputBufferLength;
+        full = nextEnd == sSerialOutputBufferStart;
+        if(full && SERIAL_OVERFLOW_DROPS_OLDEST) {
+            sSerialOutputBufferStart = (uint8_t)(nextEnd + 1) % sSerialOutputBufferLength;
+        }
+        if(!full || SERIAL_OVERFLOW_DROPS_OLDEST) {
+            sSerialOutputBuffer[end] = ch;
+            sSerialOutputBufferEnd = nextEnd;
+        }
+    }
+
+    if(full) {
+        // (Only a count, so it doesn't matter if an interrupt loses one.)
+        if(sSerialOverflowCount != 0xff) {
+            ++sSerialOverflowCount;
+        }
+        if(!SERIAL_OVERFLOW_DROPS_OLDEST) {
+            return;
+        }
+    }
+
+    // If the UART's idle, claim it and start it off. (If it's busy, the
+    // transmit complete interrupt will get to our character. If an interrupt
+    // has already sent it, there may be nothing left to send.)
+    bool idle;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        idle = !sSerialTransmitting && sSerialOutputBufferStart != sSerialOutputBufferEnd;
+        if(idle) {
+            sSerialTransmitting = true;
+        }
+    }
+    if(idle) {
+        serialSendNext();
+    }
+}
+
+void serialPrintToken(const uint8_t id, const uint8_t *args, const uint8_t argsLength)
+{
+    // Room for the frame is only ever freed up behind our back, so it's fine
+    // to check without disabling interrupts.
+    const uint8_t used = (uint8_t)(sSerialOutputBufferEnd - sSerialOutputBufferStart) % sSerialOutputBufferLength;
+    if((uint16_t)used + 2 + argsLength >= sSerialOutputBufferLength) {
+        if(sSerialOverflowCount != 0xff) {
+            ++sSerialOverflowCount;
+        }
+        return;
+    }
+
+    serialPrint(0x80 | id);
+    serialPrint(argsLength);
+    for(uint8_t i = 0; i < argsLength; ++i) {
+        serialPrint(args[i]);
+    }
 }
 
 static void serialPrintNybble(const uint8_t nybble, const bool wait)
@@ -111,13 +374,10 @@ void serialPrintDec(const uint8_t ch, const bool wait)
 
 void serialPrintStr6(const uint8_t *str6, const bool wait)
 {
+    PackedStringReader reader;
+    packedStringReaderInit(&reader, str6);
     uint8_t ch;
-    uint8_t i = 0;
-    do {
-        ch = str6CharAtIndex(str6, i);
-        if(ch) {
-            serialPrint(ch, wait);
-            ++i;
-        }
-    } while(ch != 0);
+    while((ch = str6ReadChar(&reader)) != 0) {
+        serialPrint(ch, wait);
+    }
 }
@@ -1,14 +1,41 @@
-#ifndef __timer_h_included__
-#define __timer_h_included__
+#ifndef __serial_h_included__
+#define __serial_h_included__
 
 #include <stdint.h>
 
-// This is a interrupt-free simple interface for serial output. It buffers the characters sent to it.
-// It is important that`serialpoll()` be called regularly - it is what actually outputs the characters..
+// This is a simple interface for serial output. It buffers the characters sent to it, and an
+// interrupt outputs them. It's safe to print from (ISR_NOBLOCK) interrupt handlers.
+// `serialPoll()` only needs to be called if interrupts are disabled - the 'wait' routines below
+// call it for you.
 
 void serialInit(const uint32_t baudRate);
 void serialPoll();
 
+// Waits until everything printed so far has been sent, and the UART has
+// finished with it.
+void serialFlush();
+
+// If the buffer fills up, by default new characters are dropped (so what's printed is the
+// start of what overflowed). Set this to 1 to drop the oldest buffered ones instead (not with
+// DEBUG_PRINT_TOKENIZED, below).
+#ifndef SERIAL_OVERFLOW_DROPS_OLDEST
+#define SERIAL_OVERFLOW_DROPS_OLDEST 0
+#endif
+
+// The number of characters dropped since startup (saturates at 0xff).
+uint8_t serialOverflowCount();
+
+// Set this to 1 to receive as well as send, for the serial console (see
+// console.h).
+#ifndef SERIAL_CONSOLE_ON
+#define SERIAL_CONSOLE_ON 0
+#endif
+
+#if SERIAL_CONSOLE_ON
+// Returns false if nothing's been received. Call only from the main loop.
+bool serialRead(uint8_t *ch);
+#endif
+
 // These routines usually buffer the output.
 // If  wait' is  true, they will loop calling `serialPoll()` wait until the character is being output before returning.
 // Actual _transmission_ of the character by the UART hardware will occur after the return!
@@ -20,12 +47,37 @@ void serialPrintHex16(uint16_t byte, const bool wait = false);
 void serialPrintDec(const uint8_t ch, const bool wait = false);
 void serialPrintBuffer(const void *buffer, uint8_t length);
 
+// Sends a tokenized log event (see logTokens.h). The whole frame is dropped
+// (and counted as overflow) if there isn't room for it in the buffer.
+// Don't use this from interrupt handlers - other output could end up in the
+// middle of the frame.
+void serialPrintToken(const uint8_t id, const uint8_t *args, const uint8_t argsLength);
+
 
 #ifndef DEBUG_PRINT_ON
 #define DEBUG_PRINT_ON 1
 #endif
 
+// Set this to 1 to log the busiest messages in a compact binary form, which
+// `decode_serial_log.py` can turn back into text.
+#ifndef DEBUG_PRINT_TOKENIZED
+#define DEBUG_PRINT_TOKENIZED 0
+#endif
+
+// Dropping the oldest characters on overflow would cut the start off a frame,
+// and leave `decode_serial_log.py` reading the rest of it as something else.
+#if DEBUG_PRINT_TOKENIZED && SERIAL_OVERFLOW_DROPS_OLDEST
+#error "DEBUG_PRINT_TOKENIZED can't be used with SERIAL_OVERFLOW_DROPS_OLDEST"
+#endif
+
+// Token arguments are passed as bytes - these split up larger values. e.g.:
+// debugPrintToken(LOG_SPI_READ, TOKEN_LONG(address), (uint8_t)length);
+#define TOKEN_WORD(x) (uint8_t)(x), (uint8_t)((x) >> 8)
+#define TOKEN_LONG(x) (uint8_t)(x), (uint8_t)((x) >> 8), (uint8_t)((x) >> 16), (uint8_t)((x) >> 24)
+
 #if DEBUG_PRINT_ON
+#define debugPrintToken(id, ...) do { const uint8_t __args[] = { __VA_ARGS__ }; serialPrintToken(id, __args, sizeof(__args)); } while(0)
+#define debugPrintTokenBuffer(...) serialPrintToken(__VA_ARGS__)
 #define debugPrint(...) serialPrint(__VA_ARGS__)
 #define debugPrintStr6(...) serialPrintStr6(__VA_ARGS__)
 #define debugPrintHex(...) serialPrintHex(__VA_ARGS__)
@@ -33,6 +85,8 @@ void serialPrintBuffer(const void *buffer, uint8_t length);
 #define debugPrintDec(...) serialPrintDec(__VA_ARGS__)
 #define debugPrintBuffer(...) serialPrintBuffer(__VA_ARGS__)
 #else
+#define debugPrintToken(...)
+#define debugPrintTokenBuffer(...)
 #define debugPrint(...)
 #define debugPrintStr6(...)
 #define debugPrintHex(...)
@@ -41,4 +95,4 @@ void serialPrintBuffer(const void *buffer, uint8_t length);
 #define debugPrintBuffer(...)
 #endif
 
-#endif // __timer_h_included__
+#endif // __serial_h_included__
@@ -1,7 +1,7 @@
 #include "spiMemory.h"
 #include "packedStrings.h"
 #include "serial.h"
-#include "avr/eeprom.h"
+#include "eepromLog.h"
 
 // Defaults taken from reverse-engineering at:
 // https://www.mzyy94.com/blog/2020/03/20/nintendo-switch-pro-controller-usb-gadget/
@@ -15,10 +15,8 @@
 
 struct spiSegment { const uint16_t address; const uint16_t length; const uint8_t *memory; };
 
-static const PROGMEM uint8_t x6000[] = {
-    // Serial number in non-extended ASCII. If first byte is >= x80, no S/N.
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-};
+// 0x6000: Serial number in non-extended ASCII. If first byte is >= x80, no S/N.
+// We don't have one, and unstored addresses read as 0xff, so we don't store it.
 
 static const PROGMEM uint8_t x6020[] = {
     // Accelerometer (sixaxis IMU) factory config
@@ -110,53 +108,114 @@ static const PROGMEM uint8_t x6098[] = {
 };
 #endif
 
+// The Switch reads the user calibration area, and may write to it.
+// We store it in the ATmega's EEPROM, in the log (see eepromLog.h).
+static const uint16_t sUserCalibrationAddress = 0x8010;
+static const uint16_t sUserCalibrationLength = 0x804c - 0x8010;
+
+// Segments must be sorted by address, and must not overlap - we binary search
+// through them. A NULL 'memory' pointer means the segment is the EEPROM-backed
+// user calibration area.
 static const PROGMEM spiSegment spiMemory[] = {
-    { 0x6000, sizeof(x6000), x6000 },
     { 0x6020, sizeof(x6020), x6020 },
     { 0x603d, sizeof(x603d), x603d },
     { 0x6080, sizeof(x6080), x6080 },
     { 0x6098, sizeof(x6098), x6098 },
+    { sUserCalibrationAddress, sUserCalibrationLength, NULL },
 };
 static const uint8_t spiMemoryLength = sizeof(spiMemory) / sizeof(spiSegment);
+static_assert(sUserCalibrationLength <= EEPROM_LOG_SETTINGS_ADDRESS - EEPROM_LOG_USER_CALIBRATION_ADDRESS, "User calibration doesn't fit in the EEPROM log");
+
+// The Pro Controller has 512KB of SPI flash.
+static const uint32_t sSpiMemorySize = 0x80000;
 
-bool spiMemoryRead(uint8_t *out, uint16_t address, uint16_t length)
+static uint16_t spiSegmentAddress(const uint8_t index)
 {
-    const uint16_t afterReadAddress = address + length;
+    return pgm_read_word(&spiMemory[index].address);
+}
 
-    for(uint8_t i = 0; i < spiMemoryLength; ++i) {
-        const uint16_t segmentAddress = pgm_read_word(&spiMemory[i].address);
-        if(segmentAddress <= address) {
-            const uint16_t segmentLength = pgm_read_word(&spiMemory[i].length);
+static uint32_t spiSegmentEndAddress(const uint8_t index)
+{
+    return (uint32_t)pgm_read_word(&spiMemory[index].address) + pgm_read_word(&spiMemory[index].length);
+}
 
-            const uint16_t afterSegmentEnd = segmentAddress + segmentLength;
-            if(afterSegmentEnd >= afterReadAddress) {
-                memcpy_P(out, (const uint8_t *)pgm_read_ptr(&spiMemory[i].memory) + (address - segmentAddress), length);
-                return true;
-            }
+// Returns the index of the first segment that ends after `address` (so either
+// contains it, or is the next one after it), or spiMemoryLength if there isn't
+// one.
+static uint8_t spiSegmentIndexForAddress(const uint32_t address)
+{
+    // Binary search for the first segment that starts after `address`...
+    uint8_t low = 0;
+    uint8_t high = spiMemoryLength;
+    while(low < high) {
+        const uint8_t middle = (uint8_t)(low + high) / 2;
+        if(spiSegmentAddress(middle) <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
         }
     }
 
-    if(address >= 0x8010 && afterReadAddress < 0x804c) {
-        // This range stores the user calibration data for the controller.
-        // We store this in the ATmega's EEPROM.
-        const void *eepromAddress = (const void *)(intptr_t)(address - 0x8010);
-        eeprom_read_block(out, eepromAddress, length);
+    // ...then check whether the one before it contains `address`.
+    if(low > 0 && address < spiSegmentEndAddress(low - 1)) {
+        return low - 1;
+    }
+    return low;
+}
 
-        debugPrintStr6(STR6("\n< SPI:\n"));
-        debugPrintBuffer(out, length);
+bool spiMemoryRead(uint8_t *out, uint32_t address, uint16_t length)
+{
+    const bool inRange = address < sSpiMemorySize && length <= sSpiMemorySize - address;
+
+    // Reads can span several segments, and the gaps between them. Anything
+    // we don't store reads as 0xff, like erased flash.
+    uint8_t segmentIndex = spiSegmentIndexForAddress(address);
+    while(length) {
+        uint16_t chunkLength = length;
+
+        if(segmentIndex < spiMemoryLength && spiSegmentAddress(segmentIndex) <= address) {
+            // We're inside a segment. Copy up to its end.
+            const uint32_t afterSegmentEnd = spiSegmentEndAddress(segmentIndex);
+            if(afterSegmentEnd - address < chunkLength) {
+                chunkLength = afterSegmentEnd - address;
+            }
 
-        return true;
+            const uint16_t segmentOffset = address - spiSegmentAddress(segmentIndex);
+            const uint8_t *memory = (const uint8_t *)pgm_read_ptr(&spiMemory[segmentIndex].memory);
+            if(memory) {
+                memcpy_P(out, memory + segmentOffset, chunkLength);
+            } else {
+                eepromLogReadBlock(out, EEPROM_LOG_USER_CALIBRATION_ADDRESS + segmentOffset, chunkLength);
+
+                debugPrintStr6(STR6("\n< SPI:\n"));
+                debugPrintBuffer(out, chunkLength);
+            }
+
+            ++segmentIndex;
+        } else {
+            // We're in a gap. Fill up to the start of the next segment.
+            if(segmentIndex < spiMemoryLength && spiSegmentAddress(segmentIndex) - address < chunkLength) {
+                chunkLength = spiSegmentAddress(segmentIndex) - address;
+            }
+            memset(out, 0xff, chunkLength);
+        }
+
+        out += chunkLength;
+        address += chunkLength;
+        length -= chunkLength;
     }
-    return false;
+
+    return inRange;
 }
 
-bool spiMemoryWrite(uint16_t address, const uint8_t *buffer, uint16_t length)
+bool spiMemoryWrite(uint32_t address, const uint8_t *buffer, uint16_t length)
 {
-    // This range stores the user calibration data for the controller.
-    // We store this in the ATmega's EEPROM.
-    if(address >= 0x8010 && address + length < 0x804c) {
-        void *eepromAddress = (void *)(intptr_t)(address - 0x8010);
-        eeprom_update_block(buffer, eepromAddress, length);
+    // Only the user calibration area is writable.
+    if(address >= sUserCalibrationAddress && length <= sUserCalibrationLength &&
+       address - sUserCalibrationAddress <= (uint32_t)(sUserCalibrationLength - length)) {
+        // Writing to EEPROM is slow, so this is queued up and actually
+        // happens in the background.
+        eepromLogWriteBlock(buffer, EEPROM_LOG_USER_CALIBRATION_ADDRESS + (address - sUserCalibrationAddress), length);
 
         debugPrintStr6(STR6("> SPI:\n"));
         debugPrintBuffer(buffer, length);
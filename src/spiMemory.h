@@ -4,7 +4,13 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 
-bool spiMemoryRead(uint8_t *out, uint16_t address, uint16_t length);
-bool spiMemoryWrite(uint16_t address, const uint8_t *buffer, uint16_t length);
+// Reads of addresses we don't store, within or beyond the 512KB of a real Pro
+// Controller's SPI flash, are filled with 0xff. Returns false if any of the
+// read was beyond the 512KB.
+bool spiMemoryRead(uint8_t *out, uint32_t address, uint16_t length);
+
+// Returns false if the address is not writable (only the user calibration
+// area is).
+bool spiMemoryWrite(uint32_t address, const uint8_t *buffer, uint16_t length);
 
 #endif
\ No newline at end of file
@@ -1,10 +1,12 @@
+#include "timer.h"
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
-// Very simple timer routines, only able to count milliseconds in uint8_t
-// (so only 0-255 millis before reset!)
-// We don't need to count up higher than
-// the number of timer fires it would take to get to 256ms.
+// Timer 0 overflows every 256 ticks (of 64 cycles). We count the overflows
+// to give a 32-bit tick count (and so microseconds), and separately keep an
+// 8-bit millisecond count.
 
 void timerInit() {
 // Timer set to increment every F_CPU / 64 cycles
@@ -24,21 +26,64 @@ void timerInit() {
 }
 
 // (F_CPU / 64) = Timer counts per second.
-// (F_CPU / 64) / 256 = overflows per second.
-// ((F_CPU / 64) / 256) / 1000 = overflows per millisecond.
-// ((F_CPU / 64) / 256) / 1000 * 256 = overflows per _256_ milliseconds.
-//    = (F_CPU / 64) / 1000  = overflows per 256 milliseconds.
-//    = F_CPU / 64000  = overflows per 256 milliseconds.
-static const uint8_t sTimerZeroOverflowsPer256Millis = F_CPU / 64000;
-static volatile uint8_t sTimer0FireCount = 0;
+// (F_CPU / 64) / 1000 = F_CPU / 64000 = Timer counts per millisecond.
+static const uint16_t sTimerTicksPerMilli = F_CPU / 64000;
+
+static volatile uint32_t sTimer0OverflowCount = 0;
+static uint16_t sTicksTowardsNextMilli = 0;
+static volatile uint8_t sMillis = 0;
 
 ISR(TIMER0_OVF_vect, ISR_NOBLOCK) {
-    sTimer0FireCount = (uint8_t)(sTimer0FireCount + 1) % sTimerZeroOverflowsPer256Millis;
+    // With interrupts disabled, so that an interrupt handler reading the time
+    // can't see the count half-incremented. 4 loads, 4 adds and 4 stores - 21
+    // cycles from `cli` to `sei`, inside V-USB's 25.
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        ++sTimer0OverflowCount;
+    }
+
+    // Rather than dividing every time someone asks for the time, keep the
+    // millisecond count up to date here. Each overflow is 256 ticks - 1.28ms
+    // at 12.8MHz, so this loops at most twice.
+    sTicksTowardsNextMilli += 256;
+    while(sTicksTowardsNextMilli >= sTimerTicksPerMilli) {
+        sTicksTowardsNextMilli -= sTimerTicksPerMilli;
+        ++sMillis;
+    }
 }
 
 uint8_t timerMillis() {
-    // We can't just divide by 'fires per millisecond' directly
-    // because that's ((F_CPU / 64) / 256) / 1000 - which integer-rounds to zero!
-    // So we multiply by 256 then divide by sTimerZeroFiresPer256Millis.
-    return (uint8_t)(((uint16_t)sTimer0FireCount * 256) / (uint16_t)sTimerZeroOverflowsPer256Millis);
-}
\ No newline at end of file
+    return sMillis;
+}
+
+uint32_t timerTicks32() {
+    uint32_t overflowCount;
+    uint8_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        overflowCount = sTimer0OverflowCount;
+        count = TCNT0;
+
+        // If the timer's overflowed but the interrupt hasn't run yet, the
+        // count has wrapped but the overflow count hasn't caught up.
+        // (If the count is 255, it can't have overflowed after we read it.)
+#if __AVR_ATmega8__
+        if((TIFR & (1 << TOV0)) && count != 255) {
+#else
+        if((TIFR0 & (1 << TOV0)) && count != 255) {
+#endif
+            ++overflowCount;
+        }
+    }
+    return overflowCount << 8 | count;
+}
+
+uint16_t timerTicks() {
+    return (uint16_t)timerTicks32();
+}
+
+uint16_t timerTicksSince(const uint16_t then) {
+    return timerTicks() - then;
+}
+
+uint32_t timerMicros() {
+    return timerTicks32() * TIMER_MICROS_PER_TICK;
+}
@@ -1,4 +1,33 @@
+#ifndef __timer_h_included__
+#define __timer_h_included__
+
 #include <stdint.h>
 
 void timerInit();
-uint8_t timerMillis();
\ No newline at end of file
+
+// An 8-bit count of milliseconds, for timing things shorter than 256ms.
+uint8_t timerMillis();
+
+// Timer 0 ticks every 64 cycles - 5us at 12.8MHz. (The prescaler can't be
+// changed - osctune.h's oscillator calibration depends on it.)
+#define TIMER_MICROS_PER_TICK (64000000UL / F_CPU)
+static_assert(64000000UL % F_CPU == 0, "Timer ticks aren't a whole number of microseconds");
+
+// Monotonic time since `timerInit()`, in ticks. Wraps after about 6 hours at
+// 12.8MHz.
+// Safe to call with interrupts enabled or disabled, and from interrupt
+// handlers - though one that interrupts the timer's own (ISR_NOBLOCK) handler
+// before it's counted the overflow will get a time 256 ticks early.
+uint32_t timerTicks32();
+
+// The same, in microseconds (so it wraps after about 1 hour 11 minutes).
+uint32_t timerMicros();
+
+// Just the bottom 16 bits of `timerTicks32()` - cheaper to store, and enough
+// for timing things shorter than 327ms (at 12.8MHz).
+uint16_t timerTicks();
+
+// The number of ticks from `then` (a value from `timerTicks()`) to now.
+uint16_t timerTicksSince(const uint16_t then);
+
+#endif // __timer_h_included__
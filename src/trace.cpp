@@ -0,0 +1,85 @@
+#include "trace.h"
+
+#if TRACE_ON
+
+#include "timer.h"
+#include "serial.h"
+#include "packedStrings.h"
+
+#include <util/atomic.h>
+#include <string.h>
+
+struct TraceRecord {
+    uint16_t time;
+    uint8_t event;
+    uint8_t arg;
+};
+
+// A power of two, so the ring index wraps cheaply.
+static const uint8_t sTraceLength = 32;
+static_assert(sizeof(TraceRecord) == TRACE_RECORD_SIZE, "TRACE_RECORD_SIZE is wrong");
+
+static TraceRecord sTrace[sTraceLength];
+// Whether the ring has ever wrapped - i.e. every record in it is real.
+static bool sTraceFull = false;
+static uint8_t sTraceEnd = 0;
+static uint8_t sTraceCount = 0;
+
+void traceEvent(const uint8_t event, const uint8_t arg)
+{
+    const uint16_t time = timerTicks();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TraceRecord *record = &sTrace[sTraceEnd];
+        record->time = time;
+        record->event = event;
+        record->arg = arg;
+        sTraceEnd = (uint8_t)(sTraceEnd + 1) % sTraceLength;
+        if(sTraceEnd == 0) {
+            sTraceFull = true;
+        }
+        if(sTraceCount < sTraceLength) {
+            ++sTraceCount;
+        }
+    }
+}
+
+void traceCopyLatest(uint8_t *out, const uint8_t count)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t i = (uint8_t)(sTraceEnd - count) % sTraceLength;
+        for(uint8_t copied = 0; copied < count; ++copied, i = (uint8_t)(i + 1) % sTraceLength, out += sizeof(TraceRecord)) {
+            if(sTraceFull || i < sTraceEnd) {
+                memcpy(out, &sTrace[i], sizeof(TraceRecord));
+            } else {
+                memset(out, 0xff, sizeof(TraceRecord));
+            }
+        }
+    }
+}
+
+void traceDump()
+{
+    // Take a copy of where things are, so events that happen while we're
+    // printing (which will be slow) don't confuse things.
+    uint8_t end;
+    uint8_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        end = sTraceEnd;
+        count = sTraceCount;
+        sTraceCount = 0;
+    }
+
+    serialPrintStr6(STR6("\nTRACE\n"), true);
+    for(uint8_t i = (uint8_t)(end - count) % sTraceLength; count; --count, i = (uint8_t)(i + 1) % sTraceLength) {
+        const TraceRecord *record = &sTrace[i];
+        serialPrintHex16(record->time, true);
+        serialPrint(' ', true);
+        serialPrintHex(record->event, true);
+        serialPrint(' ', true);
+        serialPrintHex(record->arg, true);
+        serialPrint('\n', true);
+    }
+    serialPrintStr6(STR6("END\n"), true);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __trace_h_included__
+#define __trace_h_included__
+
+#include <stdint.h>
+#include <string.h>
+
+// A small ring of recent events, with sub-millisecond timestamps, for seeing
+// where the time goes in each 1ms USB frame.
+//
+// `traceDump()` prints the ring over serial as:
+//     TRACE
+//     tttt ee aa
+//     ...
+//     END
+// - one line per event, oldest first, in hex: the time in timer ticks (the
+// bottom 16 bits - see `timerTicks()`), the event (below) and its argument.
+// `trace_to_chrome.py`, in the project directory, turns that into a Chrome
+// trace (chrome://tracing or https://ui.perfetto.dev) timeline.
+//
+// Off by default - the ring costs around 130 bytes of RAM, which the ATmega8
+// can't spare alongside everything else. (Check the stack still fits, with
+// `pio run -e ATmega8 -t size_report`, when switching it on.) With it off, the
+// flight recorder saves no events.
+
+#ifndef TRACE_ON
+#define TRACE_ON 0
+#endif
+
+enum TraceEvent {
+    TRACE_SOF,                  // arg: SOF count. (When the main loop notices it.)
+    TRACE_POLL_START,           // arg: DualShock command.
+    TRACE_POLL_END,             // arg: reply length.
+    TRACE_USB_SET_INTERRUPT,    // arg: position in report.
+    TRACE_OUT_PACKET,           // arg: packet length.
+    TRACE_RUMBLE_DECODE,        // arg: low channel amplitude.
+    TRACE_EEPROM_WRITE,         // arg: low byte of address.
+};
+
+// The size of each record copied by `traceCopyLatest()`: the time (2 bytes,
+// little-endian), the event and its argument.
+#define TRACE_RECORD_SIZE 4
+
+#if TRACE_ON
+// Cheap enough to call from anywhere, including interrupt handlers (see
+// `timerTicks32()` for the one way their times can be off).
+void traceEvent(const uint8_t event, const uint8_t arg);
+
+// Prints (waiting for the serial output buffer to have space) and empties
+// the ring.
+void traceDump();
+
+// Copies the latest `count` records, oldest first, into `out`. Records that
+// were never written are filled with 0xff.
+void traceCopyLatest(uint8_t *out, const uint8_t count);
+#else
+static inline void traceEvent(const uint8_t event, const uint8_t arg) {}
+static inline void traceDump() {}
+static inline void traceCopyLatest(uint8_t *out, const uint8_t count) { memset(out, 0xff, count * TRACE_RECORD_SIZE); }
+#endif
+
+#endif // __trace_h_included__
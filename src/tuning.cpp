@@ -0,0 +1,72 @@
+#include "tuning.h"
+#include "eepromLog.h"
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+static const PROGMEM uint8_t sDefaults[TUNING_PARAMETER_COUNT] = {
+    6,      // TUNING_SPI_RATE
+    20,     // TUNING_SELECT_DELAY
+    20,     // TUNING_DESELECT_DELAY
+    0,      // TUNING_STICK_DEADZONE
+    0xff,   // TUNING_RUMBLE_SCALE
+};
+
+// Saved in the EEPROM log's settings area, with a version byte first so an
+// unwritten (0xff) or out-of-date area is ignored. Bump the version if the
+// meaning of the parameters changes.
+static const uint8_t sSavedVersion = 1;
+struct SavedTuning {
+    uint8_t version;
+    uint8_t values[TUNING_PARAMETER_COUNT];
+};
+static_assert(sizeof(SavedTuning) <= EEPROM_LOG_SIZE - EEPROM_LOG_SETTINGS_ADDRESS, "Tuning doesn't fit in the settings area");
+
+static uint8_t sValues[TUNING_PARAMETER_COUNT];
+
+static void applySpiRate()
+{
+    const uint8_t rate = sValues[TUNING_SPI_RATE];
+    SPCR = (SPCR & ~(1 << SPR1 | 1 << SPR0)) | (rate & 0b11);
+    if(rate & 0b100) {
+        SPSR |= 1 << SPI2X;
+    } else {
+        SPSR &= ~(1 << SPI2X);
+    }
+}
+
+void tuningInit()
+{
+    SavedTuning saved;
+    eepromLogReadBlock(&saved, EEPROM_LOG_SETTINGS_ADDRESS, sizeof(saved));
+    for(uint8_t i = 0; i < TUNING_PARAMETER_COUNT; ++i) {
+        sValues[i] = saved.version == sSavedVersion ? saved.values[i] : pgm_read_byte(&sDefaults[i]);
+    }
+    applySpiRate();
+}
+
+uint8_t tuningGet(const uint8_t parameter)
+{
+    return sValues[parameter];
+}
+
+void tuningSet(const uint8_t parameter, const uint8_t value)
+{
+    if(parameter >= TUNING_PARAMETER_COUNT) {
+        return;
+    }
+    sValues[parameter] = value;
+    if(parameter == TUNING_SPI_RATE) {
+        applySpiRate();
+    }
+}
+
+void tuningSave()
+{
+    SavedTuning saved;
+    saved.version = sSavedVersion;
+    for(uint8_t i = 0; i < TUNING_PARAMETER_COUNT; ++i) {
+        saved.values[i] = sValues[i];
+    }
+    eepromLogWriteBlock(&saved, EEPROM_LOG_SETTINGS_ADDRESS, sizeof(saved));
+}
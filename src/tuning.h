@@ -0,0 +1,31 @@
+#ifndef __tuning_h_included__
+#define __tuning_h_included__
+
+#include <stdint.h>
+
+// Parameters that can be changed at runtime (through the serial console - see
+// console.h), rather than needing a reflash to experiment with.
+// They can be saved to the EEPROM log, and are loaded at startup.
+
+enum TuningParameter {
+    TUNING_SPI_RATE,            // Bits 0-1: SPCR's SPR1:SPR0. Bit 2: SPSR's SPI2X. Default 6 (F_CPU / 32).
+    TUNING_SELECT_DELAY,        // Microseconds from ~CS going low to the first byte. Default 20.
+    TUNING_DESELECT_DELAY,      // Microseconds from the last byte to ~CS going high. Default 20.
+    TUNING_STICK_DEADZONE,      // Stick values less than this from center read as center. Default 0.
+    TUNING_RUMBLE_SCALE,        // Rumble amplitudes are scaled by (this + 1) / 256. Default 0xff.
+    TUNING_PARAMETER_COUNT
+};
+
+// Loads any saved values (so must be called after the EEPROM log is ready),
+// and applies them. Call after setting up the SPI hardware.
+void tuningInit();
+
+uint8_t tuningGet(const uint8_t parameter);
+
+// Applies the new value straight away.
+void tuningSet(const uint8_t parameter, const uint8_t value);
+
+// Saves the current values to the EEPROM log.
+void tuningSave();
+
+#endif // __tuning_h_included__
@@ -0,0 +1,176 @@
+#include <unity.h>
+#include <string.h>
+
+#include <spiMemory.h>
+#include <eepromLog.h>
+#include <avrHost.h>
+
+// Tests for the emulated SPI flash (src/spiMemory.cpp) - finding segments,
+// reads that span segments and the gaps between them, and the 0xff fill.
+// `pio test -e native` runs them, on the host build.
+
+static uint8_t sOut[0x40];
+
+void setUp()
+{
+    memset(sOut, 0x55, sizeof(sOut));
+}
+
+void tearDown()
+{
+}
+
+static void assertFilled(const uint8_t *bytes, const uint8_t value, const uint16_t length)
+{
+    for(uint16_t i = 0; i < length; ++i) {
+        TEST_ASSERT_EQUAL_HEX8(value, bytes[i]);
+    }
+}
+
+static void testReadInsideSegment()
+{
+    // The accelerometer sensitivity, in the middle of the 0x6020 segment.
+    static const uint8_t expected[] = { 0x00, 0x40, 0x00, 0x40, 0x00, 0x40 };
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6026, sizeof(expected)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, sOut, sizeof(expected));
+    TEST_ASSERT_EQUAL_HEX8(0x55, sOut[sizeof(expected)]);
+}
+
+static void testReadWholeSegment()
+{
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6020, 24));
+    TEST_ASSERT_EQUAL_HEX8(0x00, sOut[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x3b, sOut[18]);
+    TEST_ASSERT_EQUAL_HEX8(0x34, sOut[23]);
+    TEST_ASSERT_EQUAL_HEX8(0x55, sOut[24]);
+}
+
+static void testReadAcrossGap()
+{
+    // The end of the 0x6020 segment, the gap up to 0x603d, and the start of
+    // the 0x603d segment.
+    static const uint8_t expected[] = {
+        0x3b, 0x34,
+        0xff, 0xff, 0xff, 0xff, 0xff,
+        0x77, 0x7f, 0xf7,
+    };
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6036, sizeof(expected)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, sOut, sizeof(expected));
+}
+
+static void testReadAcrossAdjacentSegments()
+{
+    // 0x6080's segment ends where 0x6098's starts.
+    static const uint8_t expected[] = { 0x36, 0x63, 0x0f, 0x30 };
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6096, sizeof(expected)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, sOut, sizeof(expected));
+}
+
+static void testReadInGaps()
+{
+    // Before the first segment.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x0000, 0x10));
+    assertFilled(sOut, 0xff, 0x10);
+
+    // Between segments.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6100, 0x10));
+    assertFilled(sOut, 0xff, 0x10);
+
+    // After the last segment.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x804c, 0x10));
+    assertFilled(sOut, 0xff, 0x10);
+    TEST_ASSERT_EQUAL_HEX8(0x55, sOut[0x10]);
+}
+
+static void testReadPastEnd()
+{
+    // Straddling the end of the 512KB - filled, but out of range.
+    TEST_ASSERT_FALSE(spiMemoryRead(sOut, 0x7fff8, 0x10));
+    assertFilled(sOut, 0xff, 0x10);
+
+    // The last byte is fine.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x7ffff, 1));
+
+    TEST_ASSERT_FALSE(spiMemoryRead(sOut, 0x80000, 1));
+    TEST_ASSERT_EQUAL_HEX8(0xff, sOut[0]);
+
+    // Far enough beyond that adding the length overflows.
+    TEST_ASSERT_FALSE(spiMemoryRead(sOut, 0xfffffff8, 0x10));
+    assertFilled(sOut, 0xff, 0x10);
+}
+
+static void testEepromSegment()
+{
+    // Unwritten user calibration reads as 0xff, like the rest.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x8010, 0x3c));
+    assertFilled(sOut, 0xff, 0x3c);
+
+    static const uint8_t calibration[] = { 0xb2, 0xa1, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+    TEST_ASSERT_TRUE(spiMemoryWrite(0x8012, calibration, sizeof(calibration)));
+
+    // Read it back, from the gap before the segment to after the write -
+    // across two of the EEPROM log's chunks.
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x800e, 4 + sizeof(calibration) + 2));
+    assertFilled(sOut, 0xff, 4);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(calibration, &sOut[4], sizeof(calibration));
+    assertFilled(&sOut[4 + sizeof(calibration)], 0xff, 2);
+
+    // The end of the segment.
+    TEST_ASSERT_TRUE(spiMemoryWrite(0x804a, calibration, 2));
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x804a, 4));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(calibration, sOut, 2);
+    assertFilled(&sOut[2], 0xff, 2);
+}
+
+static void testWholeCalibrationSaved()
+{
+    uint8_t calibration[0x3c];
+    for(uint8_t i = 0; i < sizeof(calibration); ++i) {
+        calibration[i] = i * 7;
+    }
+
+    // Writing it all at once doesn't wait for the EEPROM (time only passes
+    // on the host while the firmware waits for something).
+    const uint64_t startCycles = avrHostCycles();
+    TEST_ASSERT_TRUE(spiMemoryWrite(0x8010, calibration, sizeof(calibration)));
+    TEST_ASSERT_TRUE(avrHostCycles() == startCycles);
+
+    // Once it's saved, it's there after a restart.
+    eepromLogFlush();
+    eepromLogInit();
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x8010, sizeof(calibration)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(calibration, sOut, sizeof(calibration));
+}
+
+static void testWritesOutsideCalibrationRefused()
+{
+    static const uint8_t data[] = { 0x12, 0x34 };
+    TEST_ASSERT_FALSE(spiMemoryWrite(0x6020, data, sizeof(data)));
+    TEST_ASSERT_FALSE(spiMemoryWrite(0x800f, data, sizeof(data)));
+    TEST_ASSERT_FALSE(spiMemoryWrite(0x804b, data, sizeof(data)));
+
+    TEST_ASSERT_TRUE(spiMemoryRead(sOut, 0x6020, 2));
+    TEST_ASSERT_EQUAL_HEX8(0x00, sOut[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, sOut[1]);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    // (The emulated EEPROM starts out erased.)
+    eepromLogInit();
+
+    UNITY_BEGIN();
+    RUN_TEST(testReadInsideSegment);
+    RUN_TEST(testReadWholeSegment);
+    RUN_TEST(testReadAcrossGap);
+    RUN_TEST(testReadAcrossAdjacentSegments);
+    RUN_TEST(testReadInGaps);
+    RUN_TEST(testReadPastEnd);
+    RUN_TEST(testEepromSegment);
+    RUN_TEST(testWholeCalibrationSaved);
+    RUN_TEST(testWritesOutsideCalibrationRefused);
+    return UNITY_END();
+}
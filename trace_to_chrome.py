@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# Turns the trace dumps (see src/trace.h) in a captured serial log into a
+# Chrome trace JSON file, to view in chrome://tracing or
+# https://ui.perfetto.dev - one row per kind of activity, and a slice for each
+# 1ms USB frame.
+#
+# Usage:
+#   trace_to_chrome.py serial.log > trace.json
+#   (Or pipe the log in on stdin.)
+
+import json
+import sys
+
+f_cpu = 12800000
+microseconds_per_tick = 64 * 1000000 / f_cpu
+
+# The dump has the bottom 16 bits of the tick count.
+ticks_per_wrap = 65536
+
+TRACE_SOF = 0x00
+TRACE_POLL_START = 0x01
+TRACE_POLL_END = 0x02
+TRACE_USB_SET_INTERRUPT = 0x03
+TRACE_OUT_PACKET = 0x04
+TRACE_RUMBLE_DECODE = 0x05
+TRACE_EEPROM_WRITE = 0x06
+
+# (name, thread) for each instant event.
+instant_events = {
+    TRACE_USB_SET_INTERRUPT: ('usbSetInterrupt', 'USB IN'),
+    TRACE_OUT_PACKET: ('OUT packet', 'USB OUT'),
+    TRACE_RUMBLE_DECODE: ('Rumble decode', 'Rumble'),
+    TRACE_EEPROM_WRITE: ('EEPROM write', 'EEPROM'),
+}
+
+threads = ['Frames', 'DualShock', 'USB IN', 'USB OUT', 'Rumble', 'EEPROM', 'Other']
+
+
+def read_dumps(lines):
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if line.endswith('TRACE'):
+            dump = []
+        elif dump is not None and line == 'END':
+            yield dump
+            dump = None
+        elif dump is not None:
+            try:
+                time, event, arg = (int(field, 16) for field in line.split())
+            except ValueError:
+                # Other output got mixed in - give up on this dump.
+                dump = None
+                continue
+            dump.append((time, event, arg))
+
+
+def unwrap(dump):
+    # Turn wrapping tick counts into continuous microseconds from the start of
+    # the dump.
+    first = None
+    last = None
+    offset = 0
+    for time, event, arg in dump:
+        if last is not None and time < last:
+            offset += ticks_per_wrap
+        if first is None:
+            first = time
+        last = time
+        yield (time + offset - first) * microseconds_per_tick, event, arg
+
+
+def chrome_events(dumps):
+    events = []
+    for tid, name in enumerate(threads):
+        events.append({'ph': 'M', 'name': 'thread_name', 'pid': 0, 'tid': tid, 'args': {'name': name}})
+
+    # Lay successive dumps end to end, with a gap between them.
+    base = 0
+    for dump in dumps:
+        frame_start = None
+        poll_start = None
+        end = base
+        for time, event, arg in unwrap(dump):
+            time += base
+            end = time
+            if event == TRACE_SOF:
+                if frame_start is not None:
+                    events.append({'ph': 'X', 'name': 'Frame', 'pid': 0, 'tid': threads.index('Frames'),
+                                   'ts': frame_start[0], 'dur': time - frame_start[0], 'args': {'sof': frame_start[1]}})
+                frame_start = (time, arg)
+            elif event == TRACE_POLL_START:
+                poll_start = (time, arg)
+            elif event == TRACE_POLL_END and poll_start is not None:
+                events.append({'ph': 'X', 'name': 'Poll 0x{:02X}'.format(poll_start[1]), 'pid': 0,
+                               'tid': threads.index('DualShock'), 'ts': poll_start[0], 'dur': time - poll_start[0],
+                               'args': {'replyLength': arg}})
+                poll_start = None
+            else:
+                name, thread = instant_events.get(event, ('Event 0x{:02X}'.format(event), 'Other'))
+                events.append({'ph': 'i', 's': 't', 'name': name, 'pid': 0, 'tid': threads.index(thread),
+                               'ts': time, 'args': {'arg': arg}})
+        base = end + 10000
+    return events
+
+
+def main():
+    source = open(sys.argv[1], 'r', errors='replace') if len(sys.argv) > 1 else sys.stdin
+    json.dump({'traceEvents': chrome_events(read_dumps(source)), 'displayTimeUnit': 'ms'}, sys.stdout, indent=1)
+
+
+if __name__ == '__main__':
+    main()